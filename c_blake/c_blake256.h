@@ -1,6 +1,7 @@
 #ifndef _BLAKE256_H_
 #define _BLAKE256_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace c_blake {
@@ -32,6 +33,12 @@ namespace c_blake {
 
 	void blake224_hash(uint8_t *, const uint8_t *, uint64_t);
 
+	/* blake256_hash with SSE2/SSSE3 (c_blake256_sse.cpp) */
+	void blake256_hash_sse(uint8_t *, const uint8_t *, uint64_t);
+
+	/* n messages of the same length, eight at a time with AVX2 (c_blake256_multi.cpp) */
+	void blake256_hash_multi(uint8_t *const out[], const uint8_t *const in[], uint64_t inlen, size_t n);
+
 /* HMAC functions: */
 
 	void hmac_blake256_init(hmac_state *, const uint8_t *, uint64_t);
@@ -0,0 +1,195 @@
+/*
+ * Multi-buffer BLAKE-256 with AVX2
+ *
+ * Lane j of every 256 bit register holds word i of message j, so one pass of
+ * the compression function hashes eight messages of the same length with the
+ * scalar G network of blake256_compress. Message blocks are transposed into
+ * that layout with unpack instructions. Leftover messages go through
+ * blake256_hash_sse, built before this file.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "c_blake256.h"
+
+namespace c_blake {
+
+#ifdef __AVX2__
+
+/* rotate every 32 bit lane right by n */
+#if defined(__AVX512VL__)
+#define BLAKE8_ROTR(x, n) _mm256_ror_epi32((x), (n))
+#define BLAKE8_ROTR16(x) _mm256_ror_epi32((x), 16)
+#define BLAKE8_ROTR8(x) _mm256_ror_epi32((x), 8)
+#else
+#define BLAKE8_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+#define BLAKE8_ROTR16(x) _mm256_shuffle_epi8((x), rot16)
+#define BLAKE8_ROTR8(x) _mm256_shuffle_epi8((x), rot8)
+#endif
+
+#define BLAKE8_G(a, b, c, d, e)                                                                         \
+	v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], _mm256_xor_si256(m[s[e]], _mm256_set1_epi32(cst[s[e + 1]]))), v[b]); \
+	v[d] = BLAKE8_ROTR16(_mm256_xor_si256(v[d], v[a]));                                                   \
+	v[c] = _mm256_add_epi32(v[c], v[d]);                                                                  \
+	v[b] = BLAKE8_ROTR(_mm256_xor_si256(v[b], v[c]), 12);                                                 \
+	v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], _mm256_xor_si256(m[s[e + 1]], _mm256_set1_epi32(cst[s[e]]))), v[b]); \
+	v[d] = BLAKE8_ROTR8(_mm256_xor_si256(v[d], v[a]));                                                    \
+	v[c] = _mm256_add_epi32(v[c], v[d]);                                                                  \
+	v[b] = BLAKE8_ROTR(_mm256_xor_si256(v[b], v[c]), 7);
+
+	/* 8x8 transpose of 32 bit words, r[j] word i becomes r[i] word j */
+	static inline void blake_transpose8(__m256i r[8]) {
+		__m256i t[8], u[8];
+		for (int i = 0; i < 8; i += 2) {
+			t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+			t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+		}
+		for (int i = 0; i < 8; i += 4) {
+			u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+			u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+			u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+			u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+		}
+		for (int i = 0; i < 4; i++) {
+			r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+			r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+		}
+	}
+
+	/* one block of each of the eight messages, all with the same counter */
+	static inline void blake256_compress_x8(__m256i h[8], const uint8_t *const block[8], uint32_t t0, uint32_t t1) {
+		const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+#if !defined(__AVX512VL__)
+		const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+			13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+		const __m256i rot8 = _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1,
+			12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+#endif
+		__m256i m[16], v[16];
+		int i;
+
+		for (i = 0; i < 8; i++) {
+			m[i] = _mm256_loadu_si256((const __m256i *) block[i]);
+			m[i + 8] = _mm256_loadu_si256((const __m256i *) (block[i] + 32));
+		}
+		blake_transpose8(m);
+		blake_transpose8(m + 8);
+		for (i = 0; i < 16; i++)
+			m[i] = _mm256_shuffle_epi8(m[i], bswap);
+
+		for (i = 0; i < 8; i++)
+			v[i] = h[i];
+		for (i = 0; i < 4; i++)
+			v[i + 8] = _mm256_set1_epi32(cst[i]);
+		v[12] = _mm256_set1_epi32(0xA4093822 ^ t0);
+		v[13] = _mm256_set1_epi32(0x299F31D0 ^ t0);
+		v[14] = _mm256_set1_epi32(0x082EFA98 ^ t1);
+		v[15] = _mm256_set1_epi32(0xEC4E6C89 ^ t1);
+
+		for (i = 0; i < 14; ++i) {
+			const uint8_t *s = sigma[i];
+			BLAKE8_G(0, 4, 8, 12, 0);
+			BLAKE8_G(1, 5, 9, 13, 2);
+			BLAKE8_G(2, 6, 10, 14, 4);
+			BLAKE8_G(3, 7, 11, 15, 6);
+			BLAKE8_G(3, 4, 9, 14, 14);
+			BLAKE8_G(2, 7, 8, 13, 12);
+			BLAKE8_G(0, 5, 10, 15, 8);
+			BLAKE8_G(1, 6, 11, 12, 10);
+		}
+
+		for (i = 0; i < 8; i++)
+			h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+	}
+
+#undef BLAKE8_G
+#undef BLAKE8_ROTR
+#undef BLAKE8_ROTR16
+#undef BLAKE8_ROTR8
+
+	/* eight messages of inlen bytes */
+	static void blake256_hash_x8(uint8_t *const out[8], const uint8_t *const in[8], uint64_t inlen) {
+		static const uint32_t iv[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+		uint8_t buf[8][128];
+		const uint8_t *block[8];
+		__m256i h[8];
+		uint64_t t = 0;
+		int i, j;
+
+		for (i = 0; i < 8; i++)
+			h[i] = _mm256_set1_epi32(iv[i]);
+
+		const uint64_t full = inlen / 64;
+		for (uint64_t b = 0; b < full; b++) {
+			t += 512;
+			for (j = 0; j < 8; j++)
+				block[j] = in[j] + b * 64;
+			blake256_compress_x8(h, block, (uint32_t) t, (uint32_t) (t >> 32));
+		}
+
+		/* the padding of blake256_hash_sse, the same for every message */
+		const uint64_t rem = inlen - full * 64;
+		const uint64_t bits = inlen * 8;
+		const int pad_blocks = rem <= 55 ? 1 : 2;
+		for (j = 0; j < 8; j++) {
+			memset(buf[j], 0, sizeof(buf[j]));
+			memcpy(buf[j], in[j] + full * 64, rem);
+			buf[j][rem] = 0x80;
+			buf[j][pad_blocks * 64 - 9] |= 0x01;
+			for (i = 1; i <= 8; i++)
+				buf[j][pad_blocks * 64 - i] = (uint8_t) (bits >> (8 * (i - 1)));
+			block[j] = buf[j];
+		}
+
+		const uint64_t tlast = rem == 0 ? 0 : bits;
+		blake256_compress_x8(h, block, (uint32_t) tlast, (uint32_t) (tlast >> 32));
+		if (pad_blocks == 2) {
+			for (j = 0; j < 8; j++)
+				block[j] = buf[j] + 64;
+			blake256_compress_x8(h, block, 0, 0);
+		}
+
+		/* back to one digest per message, big endian words */
+		const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+		blake_transpose8(h);
+		for (j = 0; j < 8; j++)
+			_mm256_storeu_si256((__m256i *) out[j], _mm256_shuffle_epi8(h[j], bswap));
+	}
+
+#endif
+
+// n messages of inlen bytes
+	void blake256_hash_multi(uint8_t *const out[], const uint8_t *const in[], uint64_t inlen, size_t n) {
+#ifdef __AVX2__
+		uint8_t scratch[32];
+		const uint8_t *lane_in[8];
+		uint8_t *lane_out[8];
+
+		/* one or two messages are as fast on the SSE rows unless the rotates are single
+		 * AVX-512VL instructions */
+#if defined(__AVX512VL__)
+		const size_t min_lanes = 2;
+#else
+		const size_t min_lanes = 3;
+#endif
+		while (n >= min_lanes) {
+			const size_t used = n < 8 ? n : 8;
+			for (size_t j = 0; j < 8; j++) {
+				lane_in[j] = in[j < used ? j : 0];
+				lane_out[j] = j < used ? out[j] : scratch;
+			}
+			blake256_hash_x8(lane_out, lane_in, inlen);
+			in += used;
+			out += used;
+			n -= used;
+		}
+#endif
+		for (size_t j = 0; j < n; j++)
+			blake256_hash_sse(out[j], in[j], inlen);
+	}
+}
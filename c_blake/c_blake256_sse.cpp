@@ -0,0 +1,133 @@
+/*
+ * BLAKE-256 with SSE2, and SSSE3 byte shuffles where available
+ *
+ * The 4x4 state of blake256_compress is kept as four registers, one row
+ * each, so the four column G functions of a round run as one, and after
+ * rotating rows 1-3 the four diagonal ones as well. The permuted message
+ * words are xored with the constants in scalar registers, off the critical
+ * path of the rounds. Uses sigma and cst of c_blake256.cpp, no salt and
+ * byte aligned input only.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "c_blake256.h"
+
+namespace c_blake {
+
+/* rotate every 32 bit lane right by n */
+#if defined(__AVX512VL__)
+#define BLAKE_ROTR(x, n) _mm_ror_epi32((x), (n))
+#define BLAKE_ROTR16(x) _mm_ror_epi32((x), 16)
+#define BLAKE_ROTR8(x) _mm_ror_epi32((x), 8)
+#else
+#define BLAKE_ROTR(x, n) _mm_or_si128(_mm_srli_epi32((x), (n)), _mm_slli_epi32((x), 32 - (n)))
+#ifdef __SSSE3__
+#define BLAKE_ROTR16(x) _mm_shuffle_epi8((x), rot16)
+#define BLAKE_ROTR8(x) _mm_shuffle_epi8((x), rot8)
+#else
+#define BLAKE_ROTR16(x) _mm_shufflehi_epi16(_mm_shufflelo_epi16((x), 0xB1), 0xB1)
+#define BLAKE_ROTR8(x) BLAKE_ROTR(x, 8)
+#endif
+#endif
+
+/* message words m[sigma[r][a]] ^ cst[sigma[r][b]] for the four G of a column or diagonal step */
+#define BLAKE_MC(a0, a1, a2, a3, b0, b1, b2, b3)                                      \
+	_mm_set_epi32(m[s[a3]] ^ cst[s[b3]], m[s[a2]] ^ cst[s[b2]], m[s[a1]] ^ cst[s[b1]], m[s[a0]] ^ cst[s[b0]])
+
+#define BLAKE_G(mc0, mc1)                                             \
+	row0 = _mm_add_epi32(_mm_add_epi32(row0, mc0), row1);              \
+	row3 = BLAKE_ROTR16(_mm_xor_si128(row3, row0));                     \
+	row2 = _mm_add_epi32(row2, row3);                                   \
+	row1 = BLAKE_ROTR(_mm_xor_si128(row1, row2), 12);                   \
+	row0 = _mm_add_epi32(_mm_add_epi32(row0, mc1), row1);              \
+	row3 = BLAKE_ROTR8(_mm_xor_si128(row3, row0));                      \
+	row2 = _mm_add_epi32(row2, row3);                                   \
+	row1 = BLAKE_ROTR(_mm_xor_si128(row1, row2), 7);
+
+	static inline void blake256_compress_sse(uint32_t h[8], const uint8_t *block, uint32_t t0, uint32_t t1) {
+		uint32_t m[16];
+		int r, k;
+
+		for (k = 0; k < 16; ++k) {
+			uint32_t w;
+			memcpy(&w, block + 4 * k, 4);
+			m[k] = __builtin_bswap32(w);
+		}
+
+#if defined(__SSSE3__) && !defined(__AVX512VL__)
+		const __m128i rot16 = _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+		const __m128i rot8 = _mm_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+#endif
+		const __m128i h0 = _mm_loadu_si128((const __m128i *) h);
+		const __m128i h1 = _mm_loadu_si128((const __m128i *) (h + 4));
+		__m128i row0 = h0;
+		__m128i row1 = h1;
+		__m128i row2 = _mm_set_epi32(0x03707344, 0x13198A2E, 0x85A308D3, 0x243F6A88);
+		__m128i row3 = _mm_set_epi32(0xEC4E6C89 ^ t1, 0x082EFA98 ^ t1, 0x299F31D0 ^ t0, 0xA4093822 ^ t0);
+
+		for (r = 0; r < 14; ++r) {
+			const uint8_t *s = sigma[r];
+			BLAKE_G(BLAKE_MC(0, 2, 4, 6, 1, 3, 5, 7), BLAKE_MC(1, 3, 5, 7, 0, 2, 4, 6));
+
+			/* diagonals into columns: v5 v6 v7 v4, v10 v11 v8 v9, v15 v12 v13 v14 */
+			row1 = _mm_shuffle_epi32(row1, 0x39);
+			row2 = _mm_shuffle_epi32(row2, 0x4E);
+			row3 = _mm_shuffle_epi32(row3, 0x93);
+
+			BLAKE_G(BLAKE_MC(8, 10, 12, 14, 9, 11, 13, 15), BLAKE_MC(9, 11, 13, 15, 8, 10, 12, 14));
+
+			row1 = _mm_shuffle_epi32(row1, 0x93);
+			row2 = _mm_shuffle_epi32(row2, 0x4E);
+			row3 = _mm_shuffle_epi32(row3, 0x39);
+		}
+
+		_mm_storeu_si128((__m128i *) h, _mm_xor_si128(h0, _mm_xor_si128(row0, row2)));
+		_mm_storeu_si128((__m128i *) (h + 4), _mm_xor_si128(h1, _mm_xor_si128(row1, row3)));
+	}
+
+#undef BLAKE_MC
+#undef BLAKE_G
+#undef BLAKE_ROTR
+#undef BLAKE_ROTR16
+#undef BLAKE_ROTR8
+
+// inlen = number of bytes
+	void blake256_hash_sse(uint8_t *out, const uint8_t *in, uint64_t inlen) {
+		uint32_t h[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+		uint8_t buf[128];
+		uint64_t t = 0;
+
+		const uint64_t full = inlen / 64;
+		for (uint64_t i = 0; i < full; i++) {
+			t += 512;
+			blake256_compress_sse(h, in + i * 64, (uint32_t) t, (uint32_t) (t >> 32));
+		}
+
+		/* pad with a 1 bit, zeros, a 1 bit and the big endian bit length; blocks
+		 * without message bits are compressed with a zero counter */
+		const uint64_t rem = inlen - full * 64;
+		const uint64_t bits = inlen * 8;
+		const int pad_blocks = rem <= 55 ? 1 : 2;
+		memset(buf, 0, sizeof(buf));
+		memcpy(buf, in + full * 64, rem);
+		buf[rem] = 0x80;
+		buf[pad_blocks * 64 - 9] |= 0x01;
+		for (int i = 1; i <= 8; i++)
+			buf[pad_blocks * 64 - i] = (uint8_t) (bits >> (8 * (i - 1)));
+
+		const uint64_t tlast = rem == 0 ? 0 : bits;
+		blake256_compress_sse(h, buf, (uint32_t) tlast, (uint32_t) (tlast >> 32));
+		if (pad_blocks == 2)
+			blake256_compress_sse(h, buf + 64, 0, 0);
+
+		for (int i = 0; i < 8; i++) {
+			out[4 * i + 0] = (uint8_t) (h[i] >> 24);
+			out[4 * i + 1] = (uint8_t) (h[i] >> 16);
+			out[4 * i + 2] = (uint8_t) (h[i] >> 8);
+			out[4 * i + 3] = (uint8_t) (h[i]);
+		}
+	}
+}
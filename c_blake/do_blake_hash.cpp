@@ -6,5 +6,13 @@
 #include "do_blake_hash.hpp"
 
 void do_blake_hash(const uint8_t* input, std::size_t len, uint8_t* output) {
+	c_blake::blake256_hash_sse(output, input, len);
+}
+
+void do_blake_hash_ref(const uint8_t* input, std::size_t len, uint8_t* output) {
 	c_blake::blake256_hash(output, input, len);
 }
+
+void do_blake_hash_multi(const uint8_t* const input[], std::size_t len, uint8_t* const output[], std::size_t n) {
+	c_blake::blake256_hash_multi(output, input, len, n);
+}
@@ -6,4 +6,10 @@
 
 void do_blake_hash(const uint8_t* input, std::size_t len, uint8_t* output);
 
+// the portable reference implementation, do_blake_hash may use a SIMD one
+void do_blake_hash_ref(const uint8_t* input, std::size_t len, uint8_t* output);
+
+// n inputs of len bytes into n 32 byte outputs, several at once where the kernel has SIMD for it
+void do_blake_hash_multi(const uint8_t* const input[], std::size_t len, uint8_t* const output[], std::size_t n);
+
 #endif //C_BLAKE_DO_HASH_H
\ No newline at end of file
@@ -9,6 +9,12 @@
 #define MONERO_MASK 0x1FFFF0
 #define MONERO_ITER 0x80000
 
+// widest interleave cryptonight_multi_hash is instantiated for
+#define CN_MAX_MULTIWAY 8
+
+// widest interleave there is a hand scheduled asm main loop for, see cryptonight_asm.hpp
+#define CN_ASM_MULTIWAY 2
+
 typedef struct {
 	uint8_t hash_state[224]; // Need only 200, explicit align
 	uint8_t* long_state;
@@ -19,8 +25,31 @@ typedef struct {
 	const char* warning;
 } alloc_msg;
 
+// Finalizer profile of the calling thread, kept by the finalizer stage of cryptonight_multi_hash.
+// Indexed like extra_hashes: blake, groestl, jh, skein.
+typedef struct {
+	uint64_t hashes[4];	// hash states finalized
+	uint64_t cycles[4];	// TSC ticks spent on them
+} cn_finalizer_stats;
+
+extern thread_local cn_finalizer_stats cn_final_stats;
+
+// Pages backing long_state, kept in ctx_info[2]
+enum cryptonight_pages {
+	cn_pages_small,		// 4 KiB pages
+	cn_pages_thp,		// transparent huge pages, confirmed in /proc/self/smaps
+	cn_pages_large,		// MAP_HUGETLB or the OS equivalent
+	cn_pages_gigantic	// 1 GiB pages
+};
+
+const char* cryptonight_pages_name(uint8_t pages);
+
+// use_fast_mem - 0 slow memory, 1 large pages, 2 transparent huge pages (Linux only, NULL elsewhere)
 cryptonight_ctx* cryptonight_alloc_ctx(size_t use_fast_mem, size_t use_mlock, alloc_msg* msg);
 
+// Context on scratchpad memory owned by the caller, cryptonight_free_ctx leaves long_state alone
+cryptonight_ctx* cryptonight_wrap_ctx(uint8_t* long_state, uint8_t pages);
+
 void cryptonight_free_ctx(cryptonight_ctx* ctx);
 
 #endif
@@ -18,6 +18,8 @@
 #include "cryptonight.hpp"
 #include <memory.h>
 #include <stdio.h>
+#include <type_traits>
+#include <utility>
 
 #ifdef __GNUC__
 #include <x86intrin.h>
@@ -39,12 +41,17 @@ static inline uint64_t _umul128(uint64_t a, uint64_t b, uint64_t* hi)
 #include "soft_aes.hpp"
 
 #include "c_keccak/do_keccak_hash.hpp"
+#include "c_blake/do_blake_hash.hpp"
+#include "c_skein/do_skein_hash.hpp"
+#include "c_groestl/do_groestl_hash.hpp"
+#include "c_jh/do_jh_hash.hpp"
 
+#include "cryptonight_asm.hpp"
 
-extern "C"
-{
-	extern void(*const extra_hashes[4])(const uint8_t *, size_t, uint8_t *);
-}
+// Only included by cryptonight_kernels.cpp, so these bind to that unit's copy of the finalizers
+static void (* const extra_hashes[4])(const uint8_t *, size_t, uint8_t *) = {do_blake_hash, do_groestl_hash, do_jh_hash, do_skein_hash};
+static void (* const extra_hashes_multi[4])(const uint8_t * const *, size_t, uint8_t * const *, size_t) = {
+	do_blake_hash_multi, do_groestl_hash_multi, do_jh_hash_multi, do_skein_hash_multi};
 
 // This will shift and xor tmp1 into itself as 4 32-bit vals such as
 // sl_xor(a1 a2 a3 a4) = a1 (a2^a1) (a3^a2^a1) (a4^a3^a2^a1)
@@ -288,462 +295,344 @@ void cn_implode_scratchpad(const __m128i* input, __m128i* output)
 	_mm_store_si128(output + 11, xout7);
 }
 
-template<size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH>
-void cryptonight_hash(const void* input, size_t len, void* output, cryptonight_ctx* ctx0)
-{
-	do_keccak((const uint8_t *)input, len, ctx0->hash_state, 200);
-
-	// Optim - 99% time boundary
-	cn_explode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx0->hash_state, (__m128i*)ctx0->long_state);
-
-	uint8_t* l0 = ctx0->long_state;
-	uint64_t* h0 = (uint64_t*)ctx0->hash_state;
-
-	uint64_t al0 = h0[0] ^ h0[4];
-	uint64_t ah0 = h0[1] ^ h0[5];
-	__m128i bx0 = _mm_set_epi64x(h0[3] ^ h0[7], h0[2] ^ h0[6]);
-
-	uint64_t idx0 = h0[0] ^ h0[4];
-
-	// Optim - 90% time boundary
-	for(size_t i = 0; i < ITERATIONS; i++)
-	{
-		__m128i cx;
-		cx = _mm_load_si128((__m128i *)&l0[idx0 & MASK]);
-
-		if(SOFT_AES)
-			cx = soft_aesenc(cx, _mm_set_epi64x(ah0, al0));
-		else
-			cx = _mm_aesenc_si128(cx, _mm_set_epi64x(ah0, al0));
-
-		_mm_store_si128((__m128i *)&l0[idx0 & MASK], _mm_xor_si128(bx0, cx));
-		idx0 = _mm_cvtsi128_si64(cx);
-		bx0 = cx;
-
-		if(PREFETCH)
-			_mm_prefetch((const char*)&l0[idx0 & MASK], _MM_HINT_T0);
-
-		uint64_t hi, lo, cl, ch;
-		cl = ((uint64_t*)&l0[idx0 & MASK])[0];
-		ch = ((uint64_t*)&l0[idx0 & MASK])[1];
-
-		lo = _umul128(idx0, cl, &hi);
-
-		al0 += hi;
-		ah0 += lo;
-		((uint64_t*)&l0[idx0 & MASK])[0] = al0;
-		((uint64_t*)&l0[idx0 & MASK])[1] = ah0;
-		ah0 ^= ch;
-		al0 ^= cl;
-		idx0 = al0;
-
-		if(PREFETCH)
-			_mm_prefetch((const char*)&l0[idx0 & MASK], _MM_HINT_T0);
-	}
-
-	// Optim - 90% time boundary
-	cn_implode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx0->long_state, (__m128i*)ctx0->hash_state);
-
-	// Optim - 99% time boundary
-
-	do_keccakf((uint64_t*)ctx0->hash_state, 24);
-	extra_hashes[ctx0->hash_state[0] & 3](ctx0->hash_state, 200, (uint8_t*)output);
-}
-
-// This lovely creation will do 2 cn hashes at a time. We have plenty of space on silicon
-// to fit temporary vars for two contexts. Function will read len*2 from input and write 64 bytes to output
-// We are still limited by L3 cache, so doubling will only work with CPUs where we have more than 2MB to core (Xeons)
-template<size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH>
-void cryptonight_double_hash(const void* input, size_t len, void* output, cryptonight_ctx** ctx)
-{
-	do_keccak((const uint8_t *)input, len, ctx[0]->hash_state, 200);
-	do_keccak((const uint8_t *)input+len, len, ctx[1]->hash_state, 200);
-
-	// Optim - 99% time boundary
-	cn_explode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[0]->hash_state, (__m128i*)ctx[0]->long_state);
-	cn_explode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[1]->hash_state, (__m128i*)ctx[1]->long_state);
-
-	uint8_t* l0 = ctx[0]->long_state;
-	uint64_t* h0 = (uint64_t*)ctx[0]->hash_state;
-	uint8_t* l1 = ctx[1]->long_state;
-	uint64_t* h1 = (uint64_t*)ctx[1]->hash_state;
-
-	uint64_t axl0 = h0[0] ^ h0[4];
-	uint64_t axh0 = h0[1] ^ h0[5];
-	__m128i bx0 = _mm_set_epi64x(h0[3] ^ h0[7], h0[2] ^ h0[6]);
-	uint64_t axl1 = h1[0] ^ h1[4];
-	uint64_t axh1 = h1[1] ^ h1[5];
-	__m128i bx1 = _mm_set_epi64x(h1[3] ^ h1[7], h1[2] ^ h1[6]);
-
-	uint64_t idx0 = h0[0] ^ h0[4];
-	uint64_t idx1 = h1[0] ^ h1[4];
-
-	// Optim - 90% time boundary
-	for (size_t i = 0; i < ITERATIONS; i++)
-	{
-		__m128i cx;
-		cx = _mm_load_si128((__m128i *)&l0[idx0 & MASK]);
-
-		if(SOFT_AES)
-			cx = soft_aesenc(cx, _mm_set_epi64x(axh0, axl0));
-		else
-			cx = _mm_aesenc_si128(cx, _mm_set_epi64x(axh0, axl0));
-
-		_mm_store_si128((__m128i *)&l0[idx0 & MASK], _mm_xor_si128(bx0, cx));
-		idx0 = _mm_cvtsi128_si64(cx);
-		bx0 = cx;
-
-		if(PREFETCH)
-			_mm_prefetch((const char*)&l0[idx0 & MASK], _MM_HINT_T0);
-
-		cx = _mm_load_si128((__m128i *)&l1[idx1 & MASK]);
-
-		if(SOFT_AES)
-			cx = soft_aesenc(cx, _mm_set_epi64x(axh1, axl1));
-		else
-			cx = _mm_aesenc_si128(cx, _mm_set_epi64x(axh1, axl1));
-
-		_mm_store_si128((__m128i *)&l1[idx1 & MASK], _mm_xor_si128(bx1, cx));
-		idx1 = _mm_cvtsi128_si64(cx);
-		bx1 = cx;
-
-		if(PREFETCH)
-			_mm_prefetch((const char*)&l1[idx1 & MASK], _MM_HINT_T0);
-
-		uint64_t hi, lo, cl, ch;
-		cl = ((uint64_t*)&l0[idx0 & MASK])[0];
-		ch = ((uint64_t*)&l0[idx0 & MASK])[1];
-
-		lo = _umul128(idx0, cl, &hi);
-
-		axl0 += hi;
-		axh0 += lo;
-		((uint64_t*)&l0[idx0 & MASK])[0] = axl0;
-		((uint64_t*)&l0[idx0 & MASK])[1] = axh0;
-		axh0 ^= ch;
-		axl0 ^= cl;
-		idx0 = axl0;
-
-		if(PREFETCH)
-			_mm_prefetch((const char*)&l0[idx0 & MASK], _MM_HINT_T0);
-
-		cl = ((uint64_t*)&l1[idx1 & MASK])[0];
-		ch = ((uint64_t*)&l1[idx1 & MASK])[1];
-
-		lo = _umul128(idx1, cl, &hi);
-
-		axl1 += hi;
-		axh1 += lo;
-		((uint64_t*)&l1[idx1 & MASK])[0] = axl1;
-		((uint64_t*)&l1[idx1 & MASK])[1] = axh1;
-		axh1 ^= ch;
-		axl1 ^= cl;
-		idx1 = axl1;
-
-		if(PREFETCH)
-			_mm_prefetch((const char*)&l1[idx1 & MASK], _MM_HINT_T0);
-	}
-
-	// Optim - 90% time boundary
-	cn_implode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[0]->long_state, (__m128i*)ctx[0]->hash_state);
-	cn_implode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[1]->long_state, (__m128i*)ctx[1]->hash_state);
-
-	// Optim - 99% time boundary
-
-	do_keccakf((uint64_t*)ctx[0]->hash_state, 24);
-	extra_hashes[ctx[0]->hash_state[0] & 3](ctx[0]->hash_state, 200, (uint8_t*)output);
-	do_keccakf((uint64_t*)ctx[1]->hash_state, 24);
-	extra_hashes[ctx[1]->hash_state[0] & 3](ctx[1]->hash_state, 200, (uint8_t*)output + 32);
-}
-
+// One half round of the main loop in four phases, run for every lane before the next phase.
+// With PREFETCH the loop is pipelined: each line is prefetched as soon as its address is known,
+// in STEP2 for the line STEP3 reads and in STEP4 for the line the next STEP1 reads, so the
+// miss overlaps the stores and the phases of the other lanes instead of stalling the load.
 #define CN_STEP1(a, b, c, l, ptr, idx)				\
 	a = _mm_xor_si128(a, c);				\
 	idx = _mm_cvtsi128_si64(a);				\
 	ptr = (__m128i *)&l[idx & MASK];			\
-	if(PREFETCH)						\
-		_mm_prefetch((const char*)ptr, _MM_HINT_T0);	\
 	c = _mm_load_si128(ptr)
 
 #define CN_STEP2(a, b, c, l, ptr, idx)				\
-	if(SOFT_AES)						\
+	if(SOFT_AES_TABLE)					\
+		c = soft_aesenc_table(c, a);			\
+	else if(SOFT_AES)					\
 		c = soft_aesenc(c, a);				\
 	else							\
 		c = _mm_aesenc_si128(c, a);			\
+	if(PREFETCH)						\
+		_mm_prefetch((const char*)&l[_mm_cvtsi128_si64(c) & MASK], _MM_HINT_T0); \
 	b = _mm_xor_si128(b, c);				\
 	_mm_store_si128(ptr, b)
 
 #define CN_STEP3(a, b, c, l, ptr, idx)				\
 	idx = _mm_cvtsi128_si64(c);				\
 	ptr = (__m128i *)&l[idx & MASK];			\
-	if(PREFETCH)						\
-		_mm_prefetch((const char*)ptr, _MM_HINT_T0);	\
 	b = _mm_load_si128(ptr)
 
 #define CN_STEP4(a, b, c, l, ptr, idx)				\
 	lo = _umul128(idx, _mm_cvtsi128_si64(b), &hi);		\
 	a = _mm_add_epi64(a, _mm_set_epi64x(lo, hi));		\
+	if(PREFETCH)						\
+		_mm_prefetch((const char*)&l[(_mm_cvtsi128_si64(a) ^ _mm_cvtsi128_si64(b)) & MASK], _MM_HINT_T0); \
 	_mm_store_si128(ptr, a)
 
-// This lovelier creation will do 3 cn hashes at a time.
-template<size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH>
-void cryptonight_triple_hash(const void* input, size_t len, void* output, cryptonight_ctx** ctx)
+// Expand f(std::integral_constant<size_t, 0>) ... f(std::integral_constant<size_t, N-1>) in place.
+// The lane index is a compile time constant, so after inlining the per-lane arrays in
+// cryptonight_multi_hash are scalarised into registers exactly like the old hand-written copies.
+template<typename F, size_t... I>
+static inline void cn_unroll_impl(F&& f, std::index_sequence<I...>)
 {
-	for (size_t i = 0; i < 3; i++)
-	{
-		do_keccak((const uint8_t *)input + len * i, len, ctx[i]->hash_state, 200);
-		cn_explode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[i]->hash_state, (__m128i*)ctx[i]->long_state);
-	}
+	(f(std::integral_constant<size_t, I>()), ...);
+}
 
-	uint8_t* l0 = ctx[0]->long_state;
-	uint64_t* h0 = (uint64_t*)ctx[0]->hash_state;
-	uint8_t* l1 = ctx[1]->long_state;
-	uint64_t* h1 = (uint64_t*)ctx[1]->hash_state;
-	uint8_t* l2 = ctx[2]->long_state;
-	uint64_t* h2 = (uint64_t*)ctx[2]->hash_state;
-
-	__m128i ax0 = _mm_set_epi64x(h0[1] ^ h0[5], h0[0] ^ h0[4]);
-	__m128i bx0 = _mm_set_epi64x(h0[3] ^ h0[7], h0[2] ^ h0[6]);
-	__m128i ax1 = _mm_set_epi64x(h1[1] ^ h1[5], h1[0] ^ h1[4]);
-	__m128i bx1 = _mm_set_epi64x(h1[3] ^ h1[7], h1[2] ^ h1[6]);
-	__m128i ax2 = _mm_set_epi64x(h2[1] ^ h2[5], h2[0] ^ h2[4]);
-	__m128i bx2 = _mm_set_epi64x(h2[3] ^ h2[7], h2[2] ^ h2[6]);
-	__m128i cx0 = _mm_set_epi64x(0, 0);
-	__m128i cx1 = _mm_set_epi64x(0, 0);
-	__m128i cx2 = _mm_set_epi64x(0, 0);
-
-	for (size_t i = 0; i < ITERATIONS/2; i++)
-	{
-		uint64_t idx0, idx1, idx2, hi, lo;
-		__m128i *ptr0, *ptr1, *ptr2;
+template<size_t N, typename F>
+static inline void cn_unroll(F&& f)
+{
+	cn_unroll_impl(std::forward<F>(f), std::make_index_sequence<N>());
+}
 
-		// EVEN ROUND
-		CN_STEP1(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP1(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP1(ax2, bx2, cx2, l2, ptr2, idx2);
+// Hardware AES explode and implode over G contexts in one pass. Every round is issued for all
+// G contexts before the next one, so G * 8 independent blocks hide the AES latency. The 8 blocks
+// of a scratchpad line are encrypted 1 (xmm), 2 (ymm, vaes table) or 4 (zmm, avx512 table) per
+// instruction, the round keys are broadcast to every 128 bit lane once.
+#if defined(__VAES__) && defined(__AVX512F__)
+#define CN_AES_BLOCKS 4
+#define CN_AES_GROUP 4
+typedef __m512i cn_aes_vec;
+static inline cn_aes_vec cn_aes_key(__m128i k) { return _mm512_broadcast_i32x4(k); }
+static inline cn_aes_vec cn_aes_enc(cn_aes_vec x, cn_aes_vec k) { return _mm512_aesenc_epi128(x, k); }
+static inline cn_aes_vec cn_aes_xor(cn_aes_vec a, cn_aes_vec b) { return _mm512_xor_si512(a, b); }
+static inline cn_aes_vec cn_aes_load(const __m128i* p) { return _mm512_load_si512((const void*)p); }
+static inline void cn_aes_store(__m128i* p, cn_aes_vec x) { _mm512_store_si512((void*)p, x); }
+#elif defined(__VAES__) && defined(__AVX2__)
+#define CN_AES_BLOCKS 2
+#define CN_AES_GROUP 2
+typedef __m256i cn_aes_vec;
+static inline cn_aes_vec cn_aes_key(__m128i k) { return _mm256_broadcastsi128_si256(k); }
+static inline cn_aes_vec cn_aes_enc(cn_aes_vec x, cn_aes_vec k) { return _mm256_aesenc_epi128(x, k); }
+static inline cn_aes_vec cn_aes_xor(cn_aes_vec a, cn_aes_vec b) { return _mm256_xor_si256(a, b); }
+static inline cn_aes_vec cn_aes_load(const __m128i* p) { return _mm256_load_si256((const __m256i*)p); }
+static inline void cn_aes_store(__m128i* p, cn_aes_vec x) { _mm256_store_si256((__m256i*)p, x); }
+#else
+#define CN_AES_BLOCKS 1
+#define CN_AES_GROUP 1
+typedef __m128i cn_aes_vec;
+static inline cn_aes_vec cn_aes_key(__m128i k) { return k; }
+static inline cn_aes_vec cn_aes_enc(cn_aes_vec x, cn_aes_vec k) { return _mm_aesenc_si128(x, k); }
+static inline cn_aes_vec cn_aes_xor(cn_aes_vec a, cn_aes_vec b) { return _mm_xor_si128(a, b); }
+static inline cn_aes_vec cn_aes_load(const __m128i* p) { return _mm_load_si128(p); }
+static inline void cn_aes_store(__m128i* p, cn_aes_vec x) { _mm_store_si128(p, x); }
+#endif
 
-		CN_STEP2(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP2(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP2(ax2, bx2, cx2, l2, ptr2, idx2);
+// Scratchpad line in vector registers
+static constexpr size_t CN_AES_VECS = 8 / CN_AES_BLOCKS;
 
-		CN_STEP3(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP3(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP3(ax2, bx2, cx2, l2, ptr2, idx2);
+static inline void cn_aes_genkey(const __m128i* memory, cn_aes_vec* k)
+{
+	__m128i k128[10];
+	aes_genkey<false>(memory, &k128[0], &k128[1], &k128[2], &k128[3], &k128[4], &k128[5], &k128[6], &k128[7], &k128[8], &k128[9]);
+	for (size_t r = 0; r < 10; r++)
+		k[r] = cn_aes_key(k128[r]);
+}
 
-		CN_STEP4(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP4(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP4(ax2, bx2, cx2, l2, ptr2, idx2);
+template<size_t G, size_t MEM, bool PREFETCH>
+void cn_explode_scratchpad_group(cryptonight_ctx** ctx)
+{
+	cn_aes_vec k[G][10], x[G][CN_AES_VECS];
 
-		// ODD ROUND
-		CN_STEP1(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP1(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP1(ax2, cx2, bx2, l2, ptr2, idx2);
+	cn_unroll<G>([&](auto c) {
+		const __m128i* input = (const __m128i*)ctx[c]->hash_state;
+		cn_aes_genkey(input, k[c]);
+		cn_unroll<CN_AES_VECS>([&](auto v) { x[c][v] = cn_aes_load(input + 4 + v * CN_AES_BLOCKS); });
+	});
 
-		CN_STEP2(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP2(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP2(ax2, cx2, bx2, l2, ptr2, idx2);
+	for (size_t i = 0; i < MEM / sizeof(__m128i); i += 8)
+	{
+		for (size_t r = 0; r < 10; r++)
+			cn_unroll<G>([&](auto c) { cn_unroll<CN_AES_VECS>([&](auto v) { x[c][v] = cn_aes_enc(x[c][v], k[c][r]); }); });
+
+		cn_unroll<G>([&](auto c) {
+			__m128i* output = (__m128i*)ctx[c]->long_state;
+			cn_unroll<CN_AES_VECS>([&](auto v) { cn_aes_store(output + i + v * CN_AES_BLOCKS, x[c][v]); });
+
+			if(PREFETCH)
+			{
+				_mm_prefetch((const char*)output + i + 0, _MM_HINT_T2);
+				_mm_prefetch((const char*)output + i + 4, _MM_HINT_T2);
+			}
+		});
+	}
+}
 
-		CN_STEP3(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP3(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP3(ax2, cx2, bx2, l2, ptr2, idx2);
+template<size_t G, size_t MEM, bool PREFETCH>
+void cn_implode_scratchpad_group(cryptonight_ctx** ctx)
+{
+	cn_aes_vec k[G][10], x[G][CN_AES_VECS];
 
-		CN_STEP4(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP4(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP4(ax2, cx2, bx2, l2, ptr2, idx2);
-	}
+	cn_unroll<G>([&](auto c) {
+		const __m128i* output = (const __m128i*)ctx[c]->hash_state;
+		cn_aes_genkey(output + 2, k[c]);
+		cn_unroll<CN_AES_VECS>([&](auto v) { x[c][v] = cn_aes_load(output + 4 + v * CN_AES_BLOCKS); });
+	});
 
-	for (size_t i = 0; i < 3; i++)
+	for (size_t i = 0; i < MEM / sizeof(__m128i); i += 8)
 	{
-		cn_implode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[i]->long_state, (__m128i*)ctx[i]->hash_state);
-		do_keccakf((uint64_t*)ctx[i]->hash_state, 24);
-		extra_hashes[ctx[i]->hash_state[0] & 3](ctx[i]->hash_state, 200, (uint8_t*)output + 32 * i);
+		cn_unroll<G>([&](auto c) {
+			const __m128i* input = (const __m128i*)ctx[c]->long_state;
+			if(PREFETCH)
+			{
+				_mm_prefetch((const char*)input + i + 0, _MM_HINT_NTA);
+				_mm_prefetch((const char*)input + i + 4, _MM_HINT_NTA);
+			}
+
+			cn_unroll<CN_AES_VECS>([&](auto v) { x[c][v] = cn_aes_xor(cn_aes_load(input + i + v * CN_AES_BLOCKS), x[c][v]); });
+		});
+
+		for (size_t r = 0; r < 10; r++)
+			cn_unroll<G>([&](auto c) { cn_unroll<CN_AES_VECS>([&](auto v) { x[c][v] = cn_aes_enc(x[c][v], k[c][r]); }); });
 	}
+
+	cn_unroll<G>([&](auto c) {
+		__m128i* output = (__m128i*)ctx[c]->hash_state;
+		cn_unroll<CN_AES_VECS>([&](auto v) { cn_aes_store(output + 4 + v * CN_AES_BLOCKS, x[c][v]); });
+	});
 }
 
-// This even lovelier creation will do 4 cn hashes at a time.
-template<size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH>
-void cryptonight_quad_hash(const void* input, size_t len, void* output, cryptonight_ctx** ctx)
+// Explode and implode of N contexts as used by the kernels. Hardware AES runs them CN_AES_GROUP
+// at a time through the functions above, soft AES one at a time.
+template<size_t N, size_t MEM, bool SOFT_AES, bool PREFETCH>
+static inline void cn_explode_multi(cryptonight_ctx** ctx)
 {
-	for (size_t i = 0; i < 4; i++)
+	if constexpr(SOFT_AES)
 	{
-		do_keccak((const uint8_t *)input + len * i, len, ctx[i]->hash_state, 200);
-		cn_explode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[i]->hash_state, (__m128i*)ctx[i]->long_state);
+		for (size_t i = 0; i < N; i++)
+			cn_explode_scratchpad<MEM, true, PREFETCH>((__m128i*)ctx[i]->hash_state, (__m128i*)ctx[i]->long_state);
 	}
-
-	uint8_t* l0 = ctx[0]->long_state;
-	uint64_t* h0 = (uint64_t*)ctx[0]->hash_state;
-	uint8_t* l1 = ctx[1]->long_state;
-	uint64_t* h1 = (uint64_t*)ctx[1]->hash_state;
-	uint8_t* l2 = ctx[2]->long_state;
-	uint64_t* h2 = (uint64_t*)ctx[2]->hash_state;
-	uint8_t* l3 = ctx[3]->long_state;
-	uint64_t* h3 = (uint64_t*)ctx[3]->hash_state;
-
-	__m128i ax0 = _mm_set_epi64x(h0[1] ^ h0[5], h0[0] ^ h0[4]);
-	__m128i bx0 = _mm_set_epi64x(h0[3] ^ h0[7], h0[2] ^ h0[6]);
-	__m128i ax1 = _mm_set_epi64x(h1[1] ^ h1[5], h1[0] ^ h1[4]);
-	__m128i bx1 = _mm_set_epi64x(h1[3] ^ h1[7], h1[2] ^ h1[6]);
-	__m128i ax2 = _mm_set_epi64x(h2[1] ^ h2[5], h2[0] ^ h2[4]);
-	__m128i bx2 = _mm_set_epi64x(h2[3] ^ h2[7], h2[2] ^ h2[6]);
-	__m128i ax3 = _mm_set_epi64x(h3[1] ^ h3[5], h3[0] ^ h3[4]);
-	__m128i bx3 = _mm_set_epi64x(h3[3] ^ h3[7], h3[2] ^ h3[6]);
-	__m128i cx0 = _mm_set_epi64x(0, 0);
-	__m128i cx1 = _mm_set_epi64x(0, 0);
-	__m128i cx2 = _mm_set_epi64x(0, 0);
-	__m128i cx3 = _mm_set_epi64x(0, 0);
-
-	for (size_t i = 0; i < ITERATIONS/2; i++)
+	else
 	{
-		uint64_t idx0, idx1, idx2, idx3, hi, lo;
-		__m128i *ptr0, *ptr1, *ptr2, *ptr3;
-
-		// EVEN ROUND
-		CN_STEP1(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP1(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP1(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP1(ax3, bx3, cx3, l3, ptr3, idx3);
-
-		CN_STEP2(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP2(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP2(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP2(ax3, bx3, cx3, l3, ptr3, idx3);
-
-		CN_STEP3(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP3(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP3(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP3(ax3, bx3, cx3, l3, ptr3, idx3);
-
-		CN_STEP4(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP4(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP4(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP4(ax3, bx3, cx3, l3, ptr3, idx3);
-
-		// ODD ROUND
-		CN_STEP1(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP1(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP1(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP1(ax3, cx3, bx3, l3, ptr3, idx3);
-
-		CN_STEP2(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP2(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP2(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP2(ax3, cx3, bx3, l3, ptr3, idx3);
-
-		CN_STEP3(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP3(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP3(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP3(ax3, cx3, bx3, l3, ptr3, idx3);
-
-		CN_STEP4(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP4(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP4(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP4(ax3, cx3, bx3, l3, ptr3, idx3);
+		constexpr size_t G = N < CN_AES_GROUP ? N : CN_AES_GROUP;
+		cn_explode_scratchpad_group<G, MEM, PREFETCH>(ctx);
+		if constexpr(N > G)
+			cn_explode_multi<N - G, MEM, SOFT_AES, PREFETCH>(ctx + G);
 	}
+}
 
-	for (size_t i = 0; i < 4; i++)
+template<size_t N, size_t MEM, bool SOFT_AES, bool PREFETCH>
+static inline void cn_implode_multi(cryptonight_ctx** ctx)
+{
+	if constexpr(SOFT_AES)
+	{
+		for (size_t i = 0; i < N; i++)
+			cn_implode_scratchpad<MEM, true, PREFETCH>((__m128i*)ctx[i]->long_state, (__m128i*)ctx[i]->hash_state);
+	}
+	else
 	{
-		cn_implode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[i]->long_state, (__m128i*)ctx[i]->hash_state);
-		do_keccakf((uint64_t*)ctx[i]->hash_state, 24);
-		extra_hashes[ctx[i]->hash_state[0] & 3](ctx[i]->hash_state, 200, (uint8_t*)output + 32 * i);
+		constexpr size_t G = N < CN_AES_GROUP ? N : CN_AES_GROUP;
+		cn_implode_scratchpad_group<G, MEM, PREFETCH>(ctx);
+		if constexpr(N > G)
+			cn_implode_multi<N - G, MEM, SOFT_AES, PREFETCH>(ctx + G);
 	}
 }
 
-// This most lovely creation will do 5 cn hashes at a time.
-template<size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH>
-void cryptonight_penta_hash(const void* input, size_t len, void* output, cryptonight_ctx** ctx)
+// Keccak of the N inputs, and the final permutation of the N hash states, through the
+// multi-buffer Keccak so the AVX2 and AVX-512 tables permute 4 or 8 states per pass.
+template<size_t N>
+static inline void cn_keccak_multi(const void* input, size_t len, cryptonight_ctx** ctx)
+{
+	uint64_t* st[N];
+	for (size_t i = 0; i < N; i++)
+		st[i] = (uint64_t*)ctx[i]->hash_state;
+	do_keccak_multi((const uint8_t *)input, len, st, N);
+}
+
+template<size_t N>
+static inline void cn_keccakf_multi(cryptonight_ctx** ctx)
 {
-	for (size_t i = 0; i < 5; i++)
+	uint64_t* st[N];
+	for (size_t i = 0; i < N; i++)
+		st[i] = (uint64_t*)ctx[i]->hash_state;
+	do_keccakf_multi(st, N, 24);
+}
+
+// The N hash states bucketed by the finalizer they select, and each bucket hashed in one call.
+// A batch then makes one indirect call per finalizer in use rather than one per lane, and the
+// multi-buffer finalizers see all of their states at once. The TSC reads cost a few dozen
+// cycles per bucket against millions for the main loop.
+template<size_t N>
+static inline void cn_finalize_multi(cryptonight_ctx** ctx, uint8_t* output)
+{
+	const uint8_t* in[4][N];
+	uint8_t* out[4][N];
+	size_t cnt[4] = {0, 0, 0, 0};
+
+	for (size_t i = 0; i < N; i++)
 	{
-		do_keccak((const uint8_t *)input + len * i, len, ctx[i]->hash_state, 200);
-		cn_explode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[i]->hash_state, (__m128i*)ctx[i]->long_state);
+		const size_t f = ctx[i]->hash_state[0] & 3;
+		in[f][cnt[f]] = ctx[i]->hash_state;
+		out[f][cnt[f]++] = output + 32 * i;
 	}
 
-	uint8_t* l0 = ctx[0]->long_state;
-	uint64_t* h0 = (uint64_t*)ctx[0]->hash_state;
-	uint8_t* l1 = ctx[1]->long_state;
-	uint64_t* h1 = (uint64_t*)ctx[1]->hash_state;
-	uint8_t* l2 = ctx[2]->long_state;
-	uint64_t* h2 = (uint64_t*)ctx[2]->hash_state;
-	uint8_t* l3 = ctx[3]->long_state;
-	uint64_t* h3 = (uint64_t*)ctx[3]->hash_state;
-	uint8_t* l4 = ctx[4]->long_state;
-	uint64_t* h4 = (uint64_t*)ctx[4]->hash_state;
-
-	__m128i ax0 = _mm_set_epi64x(h0[1] ^ h0[5], h0[0] ^ h0[4]);
-	__m128i bx0 = _mm_set_epi64x(h0[3] ^ h0[7], h0[2] ^ h0[6]);
-	__m128i ax1 = _mm_set_epi64x(h1[1] ^ h1[5], h1[0] ^ h1[4]);
-	__m128i bx1 = _mm_set_epi64x(h1[3] ^ h1[7], h1[2] ^ h1[6]);
-	__m128i ax2 = _mm_set_epi64x(h2[1] ^ h2[5], h2[0] ^ h2[4]);
-	__m128i bx2 = _mm_set_epi64x(h2[3] ^ h2[7], h2[2] ^ h2[6]);
-	__m128i ax3 = _mm_set_epi64x(h3[1] ^ h3[5], h3[0] ^ h3[4]);
-	__m128i bx3 = _mm_set_epi64x(h3[3] ^ h3[7], h3[2] ^ h3[6]);
-	__m128i ax4 = _mm_set_epi64x(h4[1] ^ h4[5], h4[0] ^ h4[4]);
-	__m128i bx4 = _mm_set_epi64x(h4[3] ^ h4[7], h4[2] ^ h4[6]);
-	__m128i cx0 = _mm_set_epi64x(0, 0);
-	__m128i cx1 = _mm_set_epi64x(0, 0);
-	__m128i cx2 = _mm_set_epi64x(0, 0);
-	__m128i cx3 = _mm_set_epi64x(0, 0);
-	__m128i cx4 = _mm_set_epi64x(0, 0);
-
-	for (size_t i = 0; i < ITERATIONS/2; i++)
+	for (size_t f = 0; f < 4; f++)
+	{
+		if (cnt[f] == 0)
+			continue;
+		const uint64_t iStart = __rdtsc();
+		extra_hashes_multi[f](in[f], 200, out[f], cnt[f]);
+		cn_final_stats.cycles[f] += __rdtsc() - iStart;
+		cn_final_stats.hashes[f] += cnt[f];
+	}
+}
+
+// The main loops of N hashes at a time, interleaved so the AES and multiply latency of one
+// lane is hidden behind the others
+// SOFT_AES_TABLE runs the saes_table round even where soft_aesenc is the SSSE3 one, so cn-bench
+// can time both on the same table
+template<size_t N, size_t MASK, size_t ITERATIONS, bool SOFT_AES, bool PREFETCH, bool SOFT_AES_TABLE = false>
+static inline void cn_main_loop(cryptonight_ctx** ctx)
+{
+	uint8_t* l[N];
+	__m128i ax[N], bx[N], cx[N];
+
+	cn_unroll<N>([&](auto i) {
+		uint64_t* h = (uint64_t*)ctx[i]->hash_state;
+		l[i] = ctx[i]->long_state;
+		ax[i] = _mm_set_epi64x(h[1] ^ h[5], h[0] ^ h[4]);
+		bx[i] = _mm_set_epi64x(h[3] ^ h[7], h[2] ^ h[6]);
+		cx[i] = _mm_set_epi64x(0, 0);
+	});
+
+	for (size_t it = 0; it < ITERATIONS/2; it++)
 	{
-		uint64_t idx0, idx1, idx2, idx3, idx4, hi, lo;
-		__m128i *ptr0, *ptr1, *ptr2, *ptr3, *ptr4;
+		uint64_t idx[N], hi, lo;
+		__m128i *ptr[N];
 
 		// EVEN ROUND
-		CN_STEP1(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP1(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP1(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP1(ax3, bx3, cx3, l3, ptr3, idx3);
-		CN_STEP1(ax4, bx4, cx4, l4, ptr4, idx4);
-
-		CN_STEP2(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP2(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP2(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP2(ax3, bx3, cx3, l3, ptr3, idx3);
-		CN_STEP2(ax4, bx4, cx4, l4, ptr4, idx4);
-
-		CN_STEP3(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP3(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP3(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP3(ax3, bx3, cx3, l3, ptr3, idx3);
-		CN_STEP3(ax4, bx4, cx4, l4, ptr4, idx4);
-
-		CN_STEP4(ax0, bx0, cx0, l0, ptr0, idx0);
-		CN_STEP4(ax1, bx1, cx1, l1, ptr1, idx1);
-		CN_STEP4(ax2, bx2, cx2, l2, ptr2, idx2);
-		CN_STEP4(ax3, bx3, cx3, l3, ptr3, idx3);
-		CN_STEP4(ax4, bx4, cx4, l4, ptr4, idx4);
+		cn_unroll<N>([&](auto i) { CN_STEP1(ax[i], bx[i], cx[i], l[i], ptr[i], idx[i]); });
+		cn_unroll<N>([&](auto i) { CN_STEP2(ax[i], bx[i], cx[i], l[i], ptr[i], idx[i]); });
+		cn_unroll<N>([&](auto i) { CN_STEP3(ax[i], bx[i], cx[i], l[i], ptr[i], idx[i]); });
+		cn_unroll<N>([&](auto i) { CN_STEP4(ax[i], bx[i], cx[i], l[i], ptr[i], idx[i]); });
 
 		// ODD ROUND
-		CN_STEP1(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP1(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP1(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP1(ax3, cx3, bx3, l3, ptr3, idx3);
-		CN_STEP1(ax4, cx4, bx4, l4, ptr4, idx4);
-
-		CN_STEP2(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP2(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP2(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP2(ax3, cx3, bx3, l3, ptr3, idx3);
-		CN_STEP2(ax4, cx4, bx4, l4, ptr4, idx4);
-
-		CN_STEP3(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP3(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP3(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP3(ax3, cx3, bx3, l3, ptr3, idx3);
-		CN_STEP3(ax4, cx4, bx4, l4, ptr4, idx4);
-
-		CN_STEP4(ax0, cx0, bx0, l0, ptr0, idx0);
-		CN_STEP4(ax1, cx1, bx1, l1, ptr1, idx1);
-		CN_STEP4(ax2, cx2, bx2, l2, ptr2, idx2);
-		CN_STEP4(ax3, cx3, bx3, l3, ptr3, idx3);
-		CN_STEP4(ax4, cx4, bx4, l4, ptr4, idx4);
+		cn_unroll<N>([&](auto i) { CN_STEP1(ax[i], cx[i], bx[i], l[i], ptr[i], idx[i]); });
+		cn_unroll<N>([&](auto i) { CN_STEP2(ax[i], cx[i], bx[i], l[i], ptr[i], idx[i]); });
+		cn_unroll<N>([&](auto i) { CN_STEP3(ax[i], cx[i], bx[i], l[i], ptr[i], idx[i]); });
+		cn_unroll<N>([&](auto i) { CN_STEP4(ax[i], cx[i], bx[i], l[i], ptr[i], idx[i]); });
 	}
+}
 
-	for (size_t i = 0; i < 5; i++)
-	{
-		cn_implode_scratchpad<MEM, SOFT_AES, PREFETCH>((__m128i*)ctx[i]->long_state, (__m128i*)ctx[i]->hash_state);
-		do_keccakf((uint64_t*)ctx[i]->hash_state, 24);
-		extra_hashes[ctx[i]->hash_state[0] & 3](ctx[i]->hash_state, 200, (uint8_t*)output + 32 * i);
-	}
+// Everything but the finalizers for N hashes at a time. Reads len*N bytes from input and leaves
+// the permuted Keccak state in every ctx->hash_state. ASM runs the main loop through the hand
+// scheduled versions of cryptonight_asm.hpp, which exist for hardware AES and N <= 2 only. We
+// are still limited by L3 cache, so going wider only pays off with more than 2MB of L3 per lane.
+template<size_t N, size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH, bool ASM = false>
+static inline void cn_hash_states(const void* input, size_t len, cryptonight_ctx** ctx)
+{
+	static_assert(N >= 1 && N <= CN_MAX_MULTIWAY, "unsupported multiway width");
+	static_assert(!ASM || (!SOFT_AES && N <= CN_ASM_MULTIWAY), "no asm main loop for this configuration");
+
+	cn_keccak_multi<N>(input, len, ctx);
+	cn_explode_multi<N, MEM, SOFT_AES, PREFETCH>(ctx);
+
+#ifdef CN_HAVE_ASM_LOOPS
+	if constexpr(ASM && N == 1)
+		cn_main_loop_asm_1<MASK, ITERATIONS>(ctx);
+	else if constexpr(ASM && N == 2)
+		cn_main_loop_asm_2<MASK, ITERATIONS>(ctx);
+	else
+#endif
+		cn_main_loop<N, MASK, ITERATIONS, SOFT_AES, PREFETCH>(ctx);
+
+	cn_implode_multi<N, MEM, SOFT_AES, PREFETCH>(ctx);
+	cn_keccakf_multi<N>(ctx);
+}
+
+// Computes N cn hashes, writes 32*N bytes to output
+template<size_t N, size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH, bool ASM = false>
+void cryptonight_multi_hash(const void* input, size_t len, void* output, cryptonight_ctx** ctx)
+{
+	cn_hash_states<N, MASK, ITERATIONS, MEM, SOFT_AES, PREFETCH, ASM>(input, len, ctx);
+	cn_finalize_multi<N>(ctx, (uint8_t*)output);
+}
+
+// Computes N cn hashes and compares bytes 24..31 of each, the word the pool target applies to.
+// The digests stay in a stack buffer, only lanes below target are copied to output and set in
+// the returned mask, so the usual batch without a share writes nothing back.
+template<size_t N, size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH, bool ASM = false>
+uint32_t cryptonight_multi_hash_target(const void* input, size_t len, uint64_t target, void* output, cryptonight_ctx** ctx)
+{
+	alignas(64) uint8_t hash[32 * N];
+	uint32_t iHits = 0;
+
+	cn_hash_states<N, MASK, ITERATIONS, MEM, SOFT_AES, PREFETCH, ASM>(input, len, ctx);
+	cn_finalize_multi<N>(ctx, hash);
+
+	cn_unroll<N>([&](auto i) {
+		uint64_t iValue;
+		memcpy(&iValue, hash + 32 * i + 24, sizeof(iValue));
+		if (iValue < target)
+		{
+			iHits |= 1u << i;
+			memcpy((uint8_t*)output + 32 * i, hash + 32 * i, 32);
+		}
+	});
+	return iHits;
+}
+
+template<size_t MASK, size_t ITERATIONS, size_t MEM, bool SOFT_AES, bool PREFETCH>
+void cryptonight_hash(const void* input, size_t len, void* output, cryptonight_ctx* ctx0)
+{
+	cryptonight_multi_hash<1, MASK, ITERATIONS, MEM, SOFT_AES, PREFETCH>(input, len, output, &ctx0);
 }
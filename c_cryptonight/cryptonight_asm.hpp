@@ -0,0 +1,138 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  */
+#pragma once
+
+// Hand scheduled main loops for one and two lanes, hardware AES only. They compute exactly
+// what the CN_STEP1..4 loop of cryptonight_aesni.hpp does, but the instruction order and the
+// register allocation are fixed here instead of being left to the compiler:
+//  - the scratchpad address is masked in a 32 bit register, so no extra zero extension
+//  - the multiply takes its second operand straight from the scratchpad line, and the vector
+//    load of the same line for the next half round is issued next to it
+//  - the two lanes of the 2-way loop alternate at every step, so one lane's load or multiply
+//    latency is covered by the other's independent work
+// Only the main loop is asm, keccak, explode / implode and the finalizers are shared with the
+// intrinsics kernels.
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CN_HAVE_ASM_LOOPS 1
+#endif
+
+#ifdef CN_HAVE_ASM_LOOPS
+
+// One half round of lane L in three parts, with B the register stored to the first line and
+// C the one loaded from it (bx / cx, swapped every half round). p holds the index, t and u
+// move the rdx:rax product of mulq back to the vector unit.
+#define CN_ASM_LOAD(L, C)						\
+	"pxor %[" #C #L "], %[a" #L "]\n\t"				\
+	"movq %[a" #L "], %[p" #L "]\n\t"				\
+	"andl %[mask], %k[p" #L "]\n\t"				\
+	"movdqa (%[l" #L "],%[p" #L "]), %[" #C #L "]\n\t"
+
+#define CN_ASM_AES(L, B, C)						\
+	"aesenc %[a" #L "], %[" #C #L "]\n\t"				\
+	"pxor %[" #C #L "], %[" #B #L "]\n\t"				\
+	"movdqa %[" #B #L "], (%[l" #L "],%[p" #L "])\n\t"		\
+	"movq %[" #C #L "], %[p" #L "]\n\t"
+
+#define CN_ASM_MUL(L, B)						\
+	"movq %[p" #L "], %%rax\n\t"					\
+	"andl %[mask], %k[p" #L "]\n\t"				\
+	"movdqa (%[l" #L "],%[p" #L "]), %[" #B #L "]\n\t"		\
+	"mulq (%[l" #L "],%[p" #L "])\n\t"				\
+	"movq %%rdx, %[t" #L "]\n\t"					\
+	"movq %%rax, %[u" #L "]\n\t"					\
+	"punpcklqdq %[u" #L "], %[t" #L "]\n\t"			\
+	"paddq %[t" #L "], %[a" #L "]\n\t"				\
+	"movdqa %[a" #L "], (%[l" #L "],%[p" #L "])\n\t"
+
+template<size_t MASK, size_t ITERATIONS>
+static __attribute__((noinline)) void cn_main_loop_asm_1(cryptonight_ctx** ctx)
+{
+	static_assert(MASK < 0x80000000, "the asm loop masks the index in a 32 bit register");
+
+	uint64_t* h = (uint64_t*)ctx[0]->hash_state;
+	__m128i a0 = _mm_set_epi64x(h[1] ^ h[5], h[0] ^ h[4]);
+	__m128i b0 = _mm_set_epi64x(h[3] ^ h[7], h[2] ^ h[6]);
+	__m128i c0 = _mm_setzero_si128();
+	__m128i t0, u0;
+	uint8_t* l0 = ctx[0]->long_state;
+	uint64_t p0;
+	size_t it = ITERATIONS / 2;
+
+	__asm__ __volatile__(
+		".p2align 5\n\t"
+		"1:\n\t"
+		CN_ASM_LOAD(0, c)
+		CN_ASM_AES(0, b, c)
+		CN_ASM_MUL(0, b)
+		CN_ASM_LOAD(0, b)
+		CN_ASM_AES(0, c, b)
+		CN_ASM_MUL(0, c)
+		"decq %[it]\n\t"
+		"jnz 1b\n\t"
+		: [a0] "+x"(a0), [b0] "+x"(b0), [c0] "+x"(c0), [t0] "=&x"(t0), [u0] "=&x"(u0),
+		  [p0] "=&r"(p0), [it] "+r"(it)
+		: [l0] "r"(l0), [mask] "i"(MASK)
+		: "rax", "rdx", "cc", "memory");
+}
+
+template<size_t MASK, size_t ITERATIONS>
+static __attribute__((noinline)) void cn_main_loop_asm_2(cryptonight_ctx** ctx)
+{
+	static_assert(MASK < 0x80000000, "the asm loop masks the index in a 32 bit register");
+
+	uint64_t* h0 = (uint64_t*)ctx[0]->hash_state;
+	uint64_t* h1 = (uint64_t*)ctx[1]->hash_state;
+	__m128i a0 = _mm_set_epi64x(h0[1] ^ h0[5], h0[0] ^ h0[4]);
+	__m128i b0 = _mm_set_epi64x(h0[3] ^ h0[7], h0[2] ^ h0[6]);
+	__m128i a1 = _mm_set_epi64x(h1[1] ^ h1[5], h1[0] ^ h1[4]);
+	__m128i b1 = _mm_set_epi64x(h1[3] ^ h1[7], h1[2] ^ h1[6]);
+	__m128i c0 = _mm_setzero_si128(), c1 = _mm_setzero_si128();
+	__m128i t0, u0, t1, u1;
+	uint8_t* l0 = ctx[0]->long_state;
+	uint8_t* l1 = ctx[1]->long_state;
+	uint64_t p0, p1;
+	size_t it = ITERATIONS / 2;
+
+	__asm__ __volatile__(
+		".p2align 5\n\t"
+		"1:\n\t"
+		CN_ASM_LOAD(0, c)
+		CN_ASM_LOAD(1, c)
+		CN_ASM_AES(0, b, c)
+		CN_ASM_AES(1, b, c)
+		CN_ASM_MUL(0, b)
+		CN_ASM_MUL(1, b)
+		CN_ASM_LOAD(0, b)
+		CN_ASM_LOAD(1, b)
+		CN_ASM_AES(0, c, b)
+		CN_ASM_AES(1, c, b)
+		CN_ASM_MUL(0, c)
+		CN_ASM_MUL(1, c)
+		"decq %[it]\n\t"
+		"jnz 1b\n\t"
+		: [a0] "+x"(a0), [b0] "+x"(b0), [c0] "+x"(c0), [t0] "=&x"(t0), [u0] "=&x"(u0),
+		  [a1] "+x"(a1), [b1] "+x"(b1), [c1] "+x"(c1), [t1] "=&x"(t1), [u1] "=&x"(u1),
+		  [p0] "=&r"(p0), [p1] "=&r"(p1), [it] "+r"(it)
+		: [l0] "r"(l0), [l1] "r"(l1), [mask] "i"(MASK)
+		: "rax", "rdx", "cc", "memory");
+}
+
+#undef CN_ASM_LOAD
+#undef CN_ASM_AES
+#undef CN_ASM_MUL
+
+#endif // CN_HAVE_ASM_LOOPS
@@ -22,7 +22,6 @@
   */
 
 #include "cryptonight.hpp"
-#include "cryptonight_aesni.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -42,12 +41,95 @@
 
 #include <cassert>
 
-#include "c_blake/do_blake_hash.hpp"
-#include "c_skein/do_skein_hash.hpp"
-#include "c_groestl/do_groestl_hash.hpp"
-#include "c_jh/do_jh_hash.hpp"
+thread_local cn_finalizer_stats cn_final_stats = {};
 
-void (* const extra_hashes[4])(const uint8_t *, size_t, uint8_t *) = {do_blake_hash, do_groestl_hash, do_jh_hash, do_skein_hash};
+const char* cryptonight_pages_name(uint8_t pages)
+{
+	switch(pages)
+	{
+	case cn_pages_small:
+		return "4 KiB";
+	case cn_pages_thp:
+		return "transparent huge";
+	case cn_pages_large:
+		return "2 MiB";
+	case cn_pages_gigantic:
+		return "1 GiB";
+	}
+	return "unknown";
+}
+
+#if defined(__linux__)
+// AnonHugePages of the mapping holding addr, in bytes. Adjacent THP scratchpads may share one
+// mapping, so this only proves addr is huge if it equals the size of that mapping.
+static size_t smaps_huge_bytes(const void* addr, size_t* vma_size)
+{
+	FILE* smaps = fopen("/proc/self/smaps", "r");
+	if(smaps == NULL)
+		return 0;
+
+	char line[256];
+	bool in_vma = false;
+	size_t huge_kb = 0;
+	*vma_size = 0;
+
+	while(fgets(line, sizeof(line), smaps) != NULL)
+	{
+		unsigned long start, end;
+		if(sscanf(line, "%lx-%lx ", &start, &end) == 2)
+		{
+			if(in_vma)
+				break;
+			in_vma = (uintptr_t)addr >= start && (uintptr_t)addr < end;
+			if(in_vma)
+				*vma_size = end - start;
+		}
+		else if(in_vma && sscanf(line, "AnonHugePages: %zu kB", &huge_kb) == 1)
+			break;
+	}
+
+	fclose(smaps);
+	return huge_kb * 1024;
+}
+
+// 2 MiB aligned anonymous memory with MADV_HUGEPAGE, faulted in so the kernel has to decide now
+static uint8_t* thp_alloc(size_t size, alloc_msg* msg, uint8_t* pages)
+{
+	uint8_t* raw = (uint8_t*)mmap(0, size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(raw == MAP_FAILED)
+	{
+		msg->warning = "mmap failed";
+		return NULL;
+	}
+
+	// Trim to a size aligned window, a THP can only back an aligned 2 MiB range
+	uint8_t* base = (uint8_t*)(((uintptr_t)raw + size - 1) & ~(uintptr_t)(size - 1));
+	if(base != raw)
+		munmap(raw, base - raw);
+	munmap(base + size, raw + size - base);
+
+	if(madvise(base, size, MADV_HUGEPAGE) != 0)
+	{
+		munmap(base, size);
+		msg->warning = "transparent huge pages are disabled";
+		return NULL;
+	}
+
+#ifdef MADV_POPULATE_WRITE
+	if(madvise(base, size, MADV_POPULATE_WRITE) != 0)
+#endif
+	{
+		for(size_t i = 0; i < size; i += 4096)
+			base[i] = 0;
+	}
+
+	size_t vma_size;
+	*pages = smaps_huge_bytes(base, &vma_size) >= vma_size && vma_size >= size ? cn_pages_thp : cn_pages_small;
+	if(*pages != cn_pages_thp)
+		msg->warning = "kernel did not back the scratchpad with transparent huge pages";
+	return base;
+}
+#endif
 
 cryptonight_ctx* cryptonight_alloc_ctx(size_t use_fast_mem, size_t use_mlock, alloc_msg* msg)
 {
@@ -60,6 +142,26 @@ cryptonight_ctx* cryptonight_alloc_ctx(size_t use_fast_mem, size_t use_mlock, al
 		ptr->long_state = (uint8_t*)_mm_malloc(hashMemSize, hashMemSize);
 		ptr->ctx_info[0] = 0;
 		ptr->ctx_info[1] = 0;
+		ptr->ctx_info[2] = cn_pages_small;
+		return ptr;
+	}
+
+	if(use_fast_mem == 2)
+	{
+#if defined(__linux__)
+		ptr->long_state = thp_alloc(hashMemSize, msg, &ptr->ctx_info[2]);
+#else
+		ptr->long_state = NULL;
+		msg->warning = "transparent huge pages are not supported";
+#endif
+		if(ptr->long_state == NULL)
+		{
+			_mm_free(ptr);
+			return NULL;
+		}
+
+		ptr->ctx_info[0] = 1;
+		ptr->ctx_info[1] = use_mlock != 0 && mlock(ptr->long_state, hashMemSize) == 0;
 		return ptr;
 	}
 
@@ -79,6 +181,7 @@ cryptonight_ctx* cryptonight_alloc_ctx(size_t use_fast_mem, size_t use_mlock, al
 	}
 
 	ptr->ctx_info[0] = 1;
+	ptr->ctx_info[2] = cn_pages_large;
 
 	if(madvise(ptr->long_state, hashMemSize, MADV_RANDOM|MADV_WILLNEED) != 0)
 		msg->warning = "madvise failed";
@@ -92,18 +195,29 @@ cryptonight_ctx* cryptonight_alloc_ctx(size_t use_fast_mem, size_t use_mlock, al
 	return ptr;
 }
 
+cryptonight_ctx* cryptonight_wrap_ctx(uint8_t* long_state, uint8_t pages)
+{
+	cryptonight_ctx* ptr = (cryptonight_ctx*)_mm_malloc(sizeof(cryptonight_ctx), 4096);
+	ptr->long_state = long_state;
+	ptr->ctx_info[0] = 2;
+	ptr->ctx_info[1] = 0;
+	ptr->ctx_info[2] = pages;
+	return ptr;
+}
+
 void cryptonight_free_ctx(cryptonight_ctx* ctx)
 {
 	const size_t hashMemSize = MONERO_MEMORY;
 
-	if(ctx->ctx_info[0] != 0)
+	if(ctx->ctx_info[0] == 1)
 	{
 		if(ctx->ctx_info[1] != 0)
 			munlock(ctx->long_state, hashMemSize);
 		munmap(ctx->long_state, hashMemSize);
 	}
-	else
+	else if(ctx->ctx_info[0] == 0)
 		_mm_free(ctx->long_state);
+	// 2 - cryptonight_wrap_ctx, long_state belongs to the caller
 
 	_mm_free(ctx);
 }
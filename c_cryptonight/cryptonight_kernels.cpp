@@ -0,0 +1,195 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  */
+
+// Hash kernels for one instruction set level. CMake compiles this file once per level with
+// CN_KERNEL_ISA set to sse2, avx, avx2, vaes or avx512 and the matching -m flags, the only symbol
+// it exports is the cn_kernels_<level> table.
+//
+// Keccak, the four finalizers and the cryptonight templates are pulled in as one unit inside
+// an anonymous namespace. That gives every copy internal linkage, so the linker can never
+// merge e.g. the AVX-512 build of cryptonight_multi_hash<2, ...> into the SSE2 table.
+
+#ifndef CN_KERNEL_ISA
+#error CN_KERNEL_ISA must be set to the instruction set level this unit is built for
+#endif
+
+// System headers used by the sources below must be seen outside the namespace first
+#include <assert.h>
+#include <limits.h>
+#include <memory.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#ifdef __GNUC__
+#include <x86intrin.h>
+#else
+#include <intrin.h>
+#endif // __GNUC__
+
+#include "cryptonight.hpp"
+#include "cryptonight_kernels.hpp"
+
+namespace
+{
+#include "c_keccak/c_keccak.cpp"
+#include "c_keccak/c_keccak_multi.cpp"
+#include "c_keccak/do_keccak_hash.cpp"
+#include "c_blake/c_blake256.cpp"
+#include "c_blake/c_blake256_sse.cpp"
+#include "c_blake/c_blake256_multi.cpp"
+#include "c_blake/do_blake_hash.cpp"
+#include "c_groestl/c_groestl.cpp"
+#if defined(__AES__) && defined(__SSSE3__)
+#include "c_groestl/c_groestl_aesni.cpp"
+#endif
+#include "c_groestl/do_groestl_hash.cpp"
+#include "c_jh/c_jh.cpp"
+#include "c_jh/c_jh_sse2.cpp"
+#include "c_jh/do_jh_hash.cpp"
+#include "c_skein/c_skein.cpp"
+#include "c_skein/c_skein_multi.cpp"
+#include "c_skein/do_skein_hash.cpp"
+#include "cryptonight_aesni.hpp"
+
+	template<bool SOFT_AES, bool PREFETCH, size_t... N>
+	void fill_hash_row(cn_hash_fun_multi (&row)[CN_MAX_MULTIWAY], std::index_sequence<N...>)
+	{
+		((row[N] = cryptonight_multi_hash<N + 1, MONERO_MASK, MONERO_ITER, MONERO_MEMORY, SOFT_AES, PREFETCH>), ...);
+	}
+
+	template<bool SOFT_AES, bool PREFETCH>
+	void fill_hash_row(cn_hash_fun_multi (&row)[CN_MAX_MULTIWAY])
+	{
+		fill_hash_row<SOFT_AES, PREFETCH>(row, std::make_index_sequence<CN_MAX_MULTIWAY>());
+	}
+
+	template<bool SOFT_AES, bool PREFETCH, size_t... N>
+	void fill_hash_target_row(cn_hash_fun_target (&row)[CN_MAX_MULTIWAY], std::index_sequence<N...>)
+	{
+		((row[N] = cryptonight_multi_hash_target<N + 1, MONERO_MASK, MONERO_ITER, MONERO_MEMORY, SOFT_AES, PREFETCH>), ...);
+	}
+
+	template<bool SOFT_AES, bool PREFETCH>
+	void fill_hash_target_row(cn_hash_fun_target (&row)[CN_MAX_MULTIWAY])
+	{
+		fill_hash_target_row<SOFT_AES, PREFETCH>(row, std::make_index_sequence<CN_MAX_MULTIWAY>());
+	}
+
+	template<bool SOFT_AES, bool PREFETCH, bool SOFT_AES_TABLE, size_t... N>
+	void fill_main_loop_row(cn_main_loop_fun (&row)[CN_MAX_MULTIWAY], std::index_sequence<N...>)
+	{
+		((row[N] = cn_main_loop<N + 1, MONERO_MASK, MONERO_ITER, SOFT_AES, PREFETCH, SOFT_AES_TABLE>), ...);
+	}
+
+	template<bool SOFT_AES, bool PREFETCH, bool SOFT_AES_TABLE = false>
+	void fill_main_loop_row(cn_main_loop_fun (&row)[CN_MAX_MULTIWAY])
+	{
+		fill_main_loop_row<SOFT_AES, PREFETCH, SOFT_AES_TABLE>(row, std::make_index_sequence<CN_MAX_MULTIWAY>());
+	}
+
+	// rounds soft AES rounds on one block, each on the result of the last
+	template<bool TABLE>
+	void soft_aesenc_chain(uint8_t* block, const uint8_t* key, size_t rounds)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)block);
+		const __m128i k = _mm_loadu_si128((const __m128i*)key);
+		for (size_t i = 0; i < rounds; i++)
+			x = TABLE ? soft_aesenc_table(x, k) : soft_aesenc(x, k);
+		_mm_storeu_si128((__m128i*)block, x);
+	}
+
+	template<bool SOFT_AES>
+	void explode_scratchpad(cryptonight_ctx* ctx)
+	{
+		cn_explode_multi<1, MONERO_MEMORY, SOFT_AES, false>(&ctx);
+	}
+
+	template<bool SOFT_AES>
+	void implode_scratchpad(cryptonight_ctx* ctx)
+	{
+		cn_implode_multi<1, MONERO_MEMORY, SOFT_AES, false>(&ctx);
+	}
+
+	template<bool SOFT_AES, size_t... N>
+	void fill_scratchpad_rows(cn_kernels& k, std::index_sequence<N...>)
+	{
+		((k.explode_multi[SOFT_AES][N] = cn_explode_multi<N + 1, MONERO_MEMORY, SOFT_AES, false>), ...);
+		((k.implode_multi[SOFT_AES][N] = cn_implode_multi<N + 1, MONERO_MEMORY, SOFT_AES, false>), ...);
+	}
+
+	cn_kernels make_kernels(cn_isa_level level, const char* name)
+	{
+		cn_kernels k = {};
+		k.level = level;
+		k.name = name;
+		fill_hash_row<false, false>(k.hash[0][0]);
+		fill_hash_row<false, true>(k.hash[0][1]);
+		fill_hash_row<true, false>(k.hash[1][0]);
+		fill_hash_row<true, true>(k.hash[1][1]);
+		fill_hash_target_row<false, false>(k.hash_target[0][0]);
+		fill_hash_target_row<false, true>(k.hash_target[0][1]);
+		fill_hash_target_row<true, false>(k.hash_target[1][0]);
+		fill_hash_target_row<true, true>(k.hash_target[1][1]);
+		k.hash_asm[0] = cryptonight_multi_hash<1, MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false, true>;
+		k.hash_asm[1] = cryptonight_multi_hash<2, MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false, true>;
+		k.hash_asm_target[0] = cryptonight_multi_hash_target<1, MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false, true>;
+		k.hash_asm_target[1] = cryptonight_multi_hash_target<2, MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false, true>;
+		fill_main_loop_row<false, false>(k.main_loop[0][0]);
+		fill_main_loop_row<false, true>(k.main_loop[0][1]);
+		fill_main_loop_row<true, false>(k.main_loop[1][0]);
+		fill_main_loop_row<true, true>(k.main_loop[1][1]);
+		fill_main_loop_row<true, false, true>(k.main_loop_soft_table);
+		k.soft_aesenc_chain[0] = soft_aesenc_chain<true>;
+		k.soft_aesenc_chain[1] = soft_aesenc_chain<false>;
+#ifdef CN_HAVE_ASM_LOOPS
+		k.main_loop_asm[0] = cn_main_loop_asm_1<MONERO_MASK, MONERO_ITER>;
+		k.main_loop_asm[1] = cn_main_loop_asm_2<MONERO_MASK, MONERO_ITER>;
+#else
+		k.main_loop_asm[0] = k.main_loop[0][0][0];
+		k.main_loop_asm[1] = k.main_loop[0][0][1];
+#endif
+		k.explode[0] = explode_scratchpad<false>;
+		k.explode[1] = explode_scratchpad<true>;
+		k.implode[0] = implode_scratchpad<false>;
+		k.implode[1] = implode_scratchpad<true>;
+		fill_scratchpad_rows<false>(k, std::make_index_sequence<CN_MAX_MULTIWAY>());
+		fill_scratchpad_rows<true>(k, std::make_index_sequence<CN_MAX_MULTIWAY>());
+		k.keccak = do_keccak;
+		k.keccakf = do_keccakf;
+		k.keccakf_multi = do_keccakf_multi;
+		for (size_t i = 0; i < 4; i++)
+			k.extra_hashes[i] = extra_hashes[i];
+		k.extra_hashes_ref[0] = do_blake_hash_ref;
+		k.extra_hashes_ref[1] = do_groestl_hash_ref;
+		k.extra_hashes_ref[2] = do_jh_hash_ref;
+		k.extra_hashes_ref[3] = do_skein_hash;
+		for (size_t i = 0; i < 4; i++)
+			k.extra_hashes_multi[i] = extra_hashes_multi[i];
+		return k;
+	}
+}
+
+#define CN_KERNEL_CAT2(a, b) a ## b
+#define CN_KERNEL_CAT(a, b) CN_KERNEL_CAT2(a, b)
+#define CN_KERNEL_STR2(a) #a
+#define CN_KERNEL_STR(a) CN_KERNEL_STR2(a)
+
+extern const cn_kernels CN_KERNEL_CAT(cn_kernels_, CN_KERNEL_ISA) =
+	make_kernels(CN_KERNEL_CAT(cn_isa_, CN_KERNEL_ISA), CN_KERNEL_STR(CN_KERNEL_ISA));
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "cryptonight.hpp"
+
+// Instruction set levels the hash kernels are compiled for. cryptonight_kernels.cpp is built
+// once per level with the matching -m flags, the best level the CPU supports is picked at
+// startup (see xmrstak::cpu::select_cn_kernels).
+enum cn_isa_level
+{
+	cn_isa_sse2,	// SSE2 + AES-NI, the x86-64 baseline
+	cn_isa_avx,	// AVX + AES-NI
+	cn_isa_avx2,	// AVX2 + BMI2 + AES-NI
+	cn_isa_vaes,	// AVX2 + BMI2 + 256 bit VAES, e.g. Zen 3
+	cn_isa_avx512,	// AVX-512 F/VL/BW + 512 bit VAES
+	cn_isa_count
+};
+
+typedef void (*cn_hash_fun_multi)(const void* input, size_t len, void* output, cryptonight_ctx** ctx);
+
+// The same hash compared against a pool target: bit i of the result is set when bytes 24..31 of
+// lane i, read as a little endian word, are below target, and only those lanes write their 32
+// bytes of output.
+typedef uint32_t (*cn_hash_fun_target)(const void* input, size_t len, uint64_t target, void* output, cryptonight_ctx** ctx);
+
+// The main loop alone over N exploded scratchpads, for cn-bench
+typedef void (*cn_main_loop_fun)(cryptonight_ctx** ctx);
+
+struct cn_kernels
+{
+	cn_isa_level level;
+	const char* name;
+
+	// cryptonight_multi_hash<N, MONERO_MASK, MONERO_ITER, MONERO_MEMORY, SOFT_AES, PREFETCH>
+	// indexed as hash[SOFT_AES][PREFETCH][N - 1]. PREFETCH selects the pipelined main loop
+	// that prefetches every lane's next scratchpad line, see CN_STEP1..4.
+	cn_hash_fun_multi hash[2][2][CN_MAX_MULTIWAY];
+
+	// cryptonight_multi_hash_target, indexed like hash
+	cn_hash_fun_target hash_target[2][2][CN_MAX_MULTIWAY];
+
+	// The same with the hand scheduled main loops of cryptonight_asm.hpp, hardware AES without
+	// prefetch, indexed by N - 1. Compilers without GNU inline asm get the intrinsics loop.
+	cn_hash_fun_multi hash_asm[CN_ASM_MULTIWAY];
+	cn_hash_fun_target hash_asm_target[CN_ASM_MULTIWAY];
+
+	// The main loops the above run between explode and implode, indexed like hash and hash_asm
+	cn_main_loop_fun main_loop[2][2][CN_MAX_MULTIWAY];
+	cn_main_loop_fun main_loop_asm[CN_ASM_MULTIWAY];
+
+	// main_loop[1][0] with the saes_table round instead of soft_aesenc, for cn-bench. On the sse2
+	// table the two are the same code, from avx up soft_aesenc is the SSSE3 pshufb round.
+	cn_main_loop_fun main_loop_soft_table[CN_MAX_MULTIWAY];
+
+	// rounds dependent soft AES rounds on a 16 byte block, [0] saes_table and [1] soft_aesenc
+	void (*soft_aesenc_chain[2])(uint8_t* block, const uint8_t* key, size_t rounds);
+
+	// Scratchpad explode / implode of one context, indexed by SOFT_AES
+	void (*explode[2])(cryptonight_ctx* ctx);
+	void (*implode[2])(cryptonight_ctx* ctx);
+
+	// The same for N contexts in one interleaved pass, indexed as [SOFT_AES][N - 1]
+	void (*explode_multi[2][CN_MAX_MULTIWAY])(cryptonight_ctx** ctx);
+	void (*implode_multi[2][CN_MAX_MULTIWAY])(cryptonight_ctx** ctx);
+
+	int (*keccak)(const uint8_t* in, int inlen, uint8_t* md, int mdlen);
+	void (*keccakf)(uint64_t st[25], int norounds);
+
+	// n states per call, 4 lanes at a time on the AVX2 tables and 8 on AVX-512
+	void (*keccakf_multi)(uint64_t* st[], size_t n, int norounds);
+
+	// blake, groestl, jh, skein - selected by hash_state[0] & 3. Groestl uses AES-NI from the
+	// avx table up, Blake and JH SSE2 or better everywhere, Skein is always the C version.
+	void (*extra_hashes[4])(const uint8_t* input, size_t len, uint8_t* output);
+
+	// The portable C versions of the same four, for the self-test and cn-bench
+	void (*extra_hashes_ref[4])(const uint8_t* input, size_t len, uint8_t* output);
+
+	// n inputs of len bytes per call, what the finalizer stage of the hash runs on each bucket.
+	// Blake takes 8 and Skein 4 messages per AVX2 pass, JH 2 per AVX2 and Groestl 2 per VAES pass.
+	void (*extra_hashes_multi[4])(const uint8_t* const input[], size_t len, uint8_t* const output[], size_t n);
+};
+
+extern const cn_kernels cn_kernels_sse2;
+extern const cn_kernels cn_kernels_avx;
+extern const cn_kernels cn_kernels_avx2;
+#ifndef CN_KERNELS_NO_VAES
+extern const cn_kernels cn_kernels_vaes;
+extern const cn_kernels cn_kernels_avx512;
+#endif
+
+inline const cn_kernels& cn_get_kernels(cn_isa_level level)
+{
+#ifndef CN_KERNELS_NO_VAES
+	static const cn_kernels* const tables[cn_isa_count] = { &cn_kernels_sse2, &cn_kernels_avx, &cn_kernels_avx2, &cn_kernels_vaes, &cn_kernels_avx512 };
+#else
+	static const cn_kernels* const tables[cn_isa_count] = { &cn_kernels_sse2, &cn_kernels_avx, &cn_kernels_avx2, &cn_kernels_avx2, &cn_kernels_avx2 };
+#endif
+	return *tables[level];
+}
@@ -0,0 +1,83 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  */
+
+#include "cryptonight_pool.hpp"
+#include "c_hwlock/hwlocTopology.hpp"
+
+cryptonight_pool& cryptonight_pool::inst()
+{
+	// Never destroyed, a mining thread may still release its contexts while the process exits
+	static cryptonight_pool* instance = new cryptonight_pool();
+	return *instance;
+}
+
+cryptonight_ctx* cryptonight_pool::acquire(int numa_node, alloc_fun alloc)
+{
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+
+		// Same node first, then contexts nobody pinned (e.g. from the self-test on the main thread)
+		for(int pass = 0; pass < 2; pass++)
+		{
+			for(size_t i = vIdle.size(); i > 0; i--)
+			{
+				const int node = vIdle[i - 1].numa_node;
+				if(numa_node >= 0 && node != (pass == 0 ? numa_node : -1))
+					continue;
+
+				cryptonight_ctx* ctx = vIdle[i - 1].ctx;
+				vIdle.erase(vIdle.begin() + (i - 1));
+				return ctx;
+			}
+		}
+	}
+
+	return alloc();
+}
+
+void cryptonight_pool::release(cryptonight_ctx* ctx)
+{
+	if(ctx == nullptr)
+		return;
+
+	// -1 until the pages are faulted in, e.g. a 4 KiB pages context nobody hashed with yet
+	const int numa_node = hwlocTopology::inst().numaNodeOfArea(ctx->long_state, MONERO_MEMORY);
+
+	std::lock_guard<std::mutex> lck(mtx);
+	vIdle.push_back({ctx, numa_node});
+}
+
+size_t cryptonight_pool::trim(size_t keep)
+{
+	std::vector<idle_ctx> vFree;
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+		if(vIdle.size() <= keep)
+			return 0;
+		vFree.assign(vIdle.begin(), vIdle.end() - keep);
+		vIdle.erase(vIdle.begin(), vIdle.end() - keep);
+	}
+
+	for(const auto& idle : vFree)
+		cryptonight_free_ctx(idle.ctx);
+	return vFree.size();
+}
+
+size_t cryptonight_pool::idle() const
+{
+	std::lock_guard<std::mutex> lck(mtx);
+	return vIdle.size();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "cryptonight.hpp"
+
+#include <mutex>
+#include <vector>
+
+// Scratchpad contexts handed back by one user and given to the next, so the self-test, the
+// auto-tuner trials, the benchmarks and the mining threads share the same pre-faulted large
+// pages instead of each mapping, faulting and unmapping their own.
+class cryptonight_pool
+{
+public:
+	typedef cryptonight_ctx* (*alloc_fun)();
+
+	static cryptonight_pool& inst();
+
+	// An idle context on numa_node, else one of unknown placement, else alloc(). numa_node -1
+	// takes any idle context.
+	cryptonight_ctx* acquire(int numa_node, alloc_fun alloc);
+
+	// Keep ctx for the next acquire, filed under the NUMA node its scratchpad pages are on,
+	// asked from the kernel rather than taken from the caller. A thread pinned on one node may
+	// release a context faulted in elsewhere, e.g. one it got from the -1 fallback of acquire.
+	void release(cryptonight_ctx* ctx);
+
+	// Free every idle context, e.g. to give its large pages back before reserving the arena.
+	// Returns the number of contexts freed.
+	size_t clear() { return trim(0); }
+
+	// Free idle contexts, oldest first, until at most keep are left. Returns the number freed.
+	size_t trim(size_t keep);
+
+	size_t idle() const;
+
+private:
+	struct idle_ctx
+	{
+		cryptonight_ctx* ctx;
+		int numa_node;
+	};
+
+	cryptonight_pool() = default;
+	cryptonight_pool(const cryptonight_pool&) = delete;
+	cryptonight_pool& operator=(const cryptonight_pool&) = delete;
+
+	std::vector<idle_ctx> vIdle;
+	mutable std::mutex mtx;
+};
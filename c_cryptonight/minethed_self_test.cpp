@@ -4,16 +4,18 @@
 
 #include "minethed_self_test.h"
 #include "c_cryptonight/cryptonight.hpp"
-#include "c_cryptonight/cryptonight_aesni.hpp"
+#include "c_cryptonight/cryptonight_kernels.hpp"
+#include "c_cryptonight/cryptonight_pool.hpp"
+#include "xmrstak/backend/autoAdjust.hpp"
 #include <iostream>
 #include <array>
+#include <cstring>
+#include <random>
+#include <vector>
 
 
 namespace minethed_self_test {
 
-	typedef void (*cn_hash_fun)(const void*, size_t, void*, cryptonight_ctx*);
-	typedef void (*cn_hash_fun_multi)(const void*, size_t, void*, cryptonight_ctx**);
-
 	cryptonight_ctx * minethd_alloc_ctx() {
 		alloc_msg msg = { 0 };
 		cryptonight_ctx * ctx = cryptonight_alloc_ctx(1, 1, &msg);
@@ -27,44 +29,67 @@ namespace minethed_self_test {
 	}
 
 
-	static constexpr size_t MAX_N = 5;
+	static constexpr size_t MAX_N = CN_MAX_MULTIWAY;
 
 	bool test_func_selector() {
 		std::array<cryptonight_ctx *, MAX_N> ctx;
 		ctx.fill(nullptr);
 
 		for (int i = 0; i < ctx.size(); i++) {
-			if ((ctx[i] = minethd_alloc_ctx()) == nullptr) {
+			// The main thread is not pinned, the pool hands these to whichever thread asks next
+			if ((ctx[i] = cryptonight_pool::inst().acquire(-1, minethd_alloc_ctx)) == nullptr) {
 				for (int j = 0; j < i; j++) {
-					cryptonight_free_ctx(ctx[j]);
+					cryptonight_pool::inst().release(ctx[j]);
 				}
 				return false;
 			}
 		}
 
-		const std::array<cn_hash_fun, 4> func_table = {
-			cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false>,
-			cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, true>,
-			cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, false>,
-			cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, true>
-		};
+		// Every instruction set level this CPU can run gets the 1x check, so a miscompiled
+		// table is caught even if it is not the one select_cn_kernels picks.
+		const xmrstak::cpu::cpu_features features = xmrstak::cpu::get_cpu_features();
 
 		bool bResult = true;
 
 		std::array<unsigned char, 32 * MAX_N> out;
-		for (int i = 0; i < func_table.size(); i++) {
-			const auto hashf = func_table[i];
-			hashf("This is a test", 14, &out[0], ctx[0]);
-			bResult &= memcmp(&out[0], "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 32) == 0;
-			if (!bResult) {
-				std::cout << __FILE__ << ":" << __LINE__ << ": Failed self test on i=" << i << std::endl;
-			} else {
-				std::cout << __FILE__ << ":" << __LINE__ << ": Passed self test on i=" << i << std::endl;
+		for (int level = 0; level < cn_isa_count; level++) {
+			if (!xmrstak::cpu::cn_kernels_supported(features, (cn_isa_level)level)) {
+				continue;
+			}
+			const cn_kernels& kernels = cn_get_kernels((cn_isa_level)level);
+
+			// i = SOFT_AES << 1 | PREFETCH
+			for (int i = features.aes ? 0 : 2; i < 4; i++) {
+				const auto hashf = kernels.hash[i >> 1][i & 1][0];
+				hashf("This is a test", 14, &out[0], &ctx[0]);
+				bResult &= memcmp(&out[0], "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 32) == 0;
+				if (!bResult) {
+					std::cout << __FILE__ << ":" << __LINE__ << ": Failed self test on " << kernels.name << " i=" << i << std::endl;
+				} else {
+					std::cout << __FILE__ << ":" << __LINE__ << ": Passed self test on " << kernels.name << " i=" << i << std::endl;
+				}
+			}
+
+			// The hand scheduled main loops, hardware AES only
+			if (features.aes) {
+				kernels.hash_asm[0]("This is a test", 14, &out[0], &ctx[0]);
+				bResult &= memcmp(&out[0], "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 32) == 0;
+				bResult &= kernels.hash_asm_target[0]("This is a test", 14, ~0ULL, &out[0], &ctx[0]) == 1;
+
+				const char* fox = "The quick brown fox jumps over the lazy dogThe quick brown fox jumps over the lazy log";
+				kernels.hash_asm[1](fox, 43, &out[0], &ctx[0]);
+				bResult &= memcmp(&out[0], "\x3e\xbb\x7f\x9f\x7d\x27\x3d\x7c\x31\x8d\x86\x94\x77\x55\x0c\xc8\x00\xcf\xb1\x1b\x0c\xad\xb7\xff\xbd\xf6\xf8\x9f\x3a\x47\x1c\x59\xb4\x77\xd5\x02\xe4\xd8\x48\x7f\x42\xdf\xe3\x8e\xed\x73\x81\x7a\xda\x91\xb7\xe2\x63\xd2\x91\x71\xb6\x5c\x44\x3a\x01\x2a\x41\x22", 64) == 0;
+				bResult &= kernels.hash_asm_target[1](fox, 43, 0x591c473a9ff8f6bdULL, &out[0], &ctx[0]) == 2;
+				if (!bResult) {
+					std::cout << __FILE__ << ":" << __LINE__ << ": Failed asm self test on " << kernels.name << std::endl;
+				} else {
+					std::cout << __FILE__ << ":" << __LINE__ << ": Passed asm self test on " << kernels.name << std::endl;
+				}
 			}
 		}
 
 		for (int i = 0; i < ctx.size(); i++) {
-			cryptonight_free_ctx(ctx[i]);
+			cryptonight_pool::inst().release(ctx[i]);
 		}
 
 		if(!bResult) {
@@ -84,96 +109,97 @@ namespace minethed_self_test {
 		ctx.fill(nullptr);
 
 		for (int i = 0; i < ctx.size(); i++) {
-			if ((ctx[i] = minethd_alloc_ctx()) == nullptr) {
+			// The main thread is not pinned, the pool hands these to whichever thread asks next
+			if ((ctx[i] = cryptonight_pool::inst().acquire(-1, minethd_alloc_ctx)) == nullptr) {
 				for (int j = 0; j < i; j++) {
-					cryptonight_free_ctx(ctx[j]);
+					cryptonight_pool::inst().release(ctx[j]);
 				}
 				return false;
 			}
 		}
 
-		const std::array<cn_hash_fun, 4> func_table_1x = {
-				cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false>,
-				cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, true>,
-				cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, false>,
-				cryptonight_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, true>
-		};
-		const std::array<cn_hash_fun_multi, 4> func_table_2x = {
-				cryptonight_double_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false>,
-				cryptonight_double_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, true>,
-				cryptonight_double_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, false>,
-				cryptonight_double_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, true>,
-		};
-		const std::array<cn_hash_fun_multi, 4> func_table_3x = {
-			cryptonight_triple_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false>,
-			cryptonight_triple_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, true>,
-			cryptonight_triple_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, false>,
-			cryptonight_triple_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, true>,
-		};
-		const std::array<cn_hash_fun_multi, 4> func_table_4x = {
-			cryptonight_quad_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false>,
-			cryptonight_quad_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, true>,
-			cryptonight_quad_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, false>,
-			cryptonight_quad_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, true>,
-		};
-		const std::array<cn_hash_fun_multi, 4> func_table_5x = {
-			cryptonight_penta_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, false>,
-			cryptonight_penta_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, false, true>,
-			cryptonight_penta_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, false>,
-			cryptonight_penta_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, true, true>
-		};
+		const cn_kernels& kernels = xmrstak::cpu::select_cn_kernels();
 
 		bool bResult = true;
 
 		std::array<unsigned char, 32 * MAX_N> out;
-		for (int i = 0; i < 4; i++) {
+		// i = SOFT_AES << 1 | PREFETCH
+		for (int i = xmrstak::cpu::get_cpu_features().aes ? 0 : 2; i < 4; i++) {
 			// 1x
 			{
-				const auto hashf = func_table_1x[i];
-				hashf("This is a test", 14, &out[0], ctx[0]);
+				const auto hashf = kernels.hash[i >> 1][i & 1][0];
+				hashf("This is a test", 14, &out[0], &ctx[0]);
 				bResult &= memcmp(&out[0], "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 32) == 0;
 			}
 			// 2x
 			{
 				unsigned char out[32 * MAX_N];
-				const auto hashf_multi = func_table_2x[i];
+				const auto hashf_multi = kernels.hash[i >> 1][i & 1][1];
 				hashf_multi("The quick brown fox jumps over the lazy dogThe quick brown fox jumps over the lazy log", 43, out, &ctx[0]);
 				bResult &= memcmp(out, "\x3e\xbb\x7f\x9f\x7d\x27\x3d\x7c\x31\x8d\x86\x94\x77\x55\x0c\xc8\x00\xcf\xb1\x1b\x0c\xad\xb7\xff\xbd\xf6\xf8\x9f\x3a\x47\x1c\x59\xb4\x77\xd5\x02\xe4\xd8\x48\x7f\x42\xdf\xe3\x8e\xed\x73\x81\x7a\xda\x91\xb7\xe2\x63\xd2\x91\x71\xb6\x5c\x44\x3a\x01\x2a\x41\x22", 64) == 0;
 
 				hashf_multi("The quick brown fox jumps over the lazy dogThe quick brown fox jumps over the lazy log", 43, out, &ctx[0]);
 				bResult &= memcmp(out, "\x3e\xbb\x7f\x9f\x7d\x27\x3d\x7c\x31\x8d\x86\x94\x77\x55\x0c\xc8\x00\xcf\xb1\x1b\x0c\xad\xb7\xff\xbd\xf6\xf8\x9f\x3a\x47\x1c\x59\xb4\x77\xd5\x02\xe4\xd8\x48\x7f\x42\xdf\xe3\x8e\xed\x73\x81\x7a\xda\x91\xb7\xe2\x63\xd2\x91\x71\xb6\x5c\x44\x3a\x01\x2a\x41\x22", 64) == 0;
 			}
+			// 2x against a target, word 3 of the first hash only lets the second through
+			{
+				unsigned char out[32 * MAX_N];
+				const auto hashf_target = kernels.hash_target[i >> 1][i & 1][1];
+				const char* in = "The quick brown fox jumps over the lazy dogThe quick brown fox jumps over the lazy log";
+
+				memset(out, 0xAA, sizeof(out));
+				bResult &= hashf_target(in, 43, 0x591c473a9ff8f6bdULL, out, &ctx[0]) == 2;
+				bResult &= memcmp(out + 32, "\xb4\x77\xd5\x02\xe4\xd8\x48\x7f\x42\xdf\xe3\x8e\xed\x73\x81\x7a\xda\x91\xb7\xe2\x63\xd2\x91\x71\xb6\x5c\x44\x3a\x01\x2a\x41\x22", 32) == 0;
+				bResult &= out[0] == 0xAA && memcmp(out, out + 1, 31) == 0;
+
+				bResult &= hashf_target(in, 43, ~0ULL, out, &ctx[0]) == 3;
+				bResult &= memcmp(out, "\x3e\xbb\x7f\x9f\x7d\x27\x3d\x7c\x31\x8d\x86\x94\x77\x55\x0c\xc8\x00\xcf\xb1\x1b\x0c\xad\xb7\xff\xbd\xf6\xf8\x9f\x3a\x47\x1c\x59", 32) == 0;
+
+				bResult &= hashf_target(in, 43, 0, out, &ctx[0]) == 0;
+			}
 			// 3x
 			{
 				unsigned char out[32 * MAX_N];
-				const auto hashf_multi = func_table_3x[i];
+				const auto hashf_multi = kernels.hash[i >> 1][i & 1][2];
 				hashf_multi("This is a testThis is a testThis is a test", 14, out, &ctx[0]);
 				bResult &= memcmp(out, "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 96) == 0;
 			}
 			// 4x
 			{
 				unsigned char out[32 * MAX_N];
-				const auto hashf_multi = func_table_4x[i];
+				const auto hashf_multi = kernels.hash[i >> 1][i & 1][3];
 				hashf_multi("This is a testThis is a testThis is a testThis is a test", 14, out, &ctx[0]);
 				bResult &= memcmp(out, "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 128) == 0;
 			}
 			// 5x
 			{
 				unsigned char out[32 * MAX_N];
-				const auto hashf_multi = func_table_5x[i];
+				const auto hashf_multi = kernels.hash[i >> 1][i & 1][4];
 				hashf_multi("This is a testThis is a testThis is a testThis is a testThis is a test", 14, out, &ctx[0]);
 				bResult &= memcmp(out, "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 160) == 0;
 			}
 
+			// 6x - 8x
+			{
+				unsigned char out[32 * MAX_N];
+				const unsigned char in[] = "This is a testThis is a testThis is a testThis is a testThis is a testThis is a testThis is a testThis is a test";
+				for (size_t n = 6; n <= MAX_N; n++) {
+					kernels.hash[i >> 1][i & 1][n - 1](in, 14, out, &ctx[0]);
+					for (size_t lane = 0; lane < n; lane++) {
+						bResult &= memcmp(out + 32 * lane, "\xa0\x84\xf0\x1d\x14\x37\xa0\x9c\x69\x85\x40\x1b\x60\xd4\x35\x54\xae\x10\x58\x02\xc5\xf5\xd8\xa9\xb3\x25\x36\x49\xc0\xbe\x66\x05", 32) == 0;
+					}
+				}
+			}
+
 			if (!bResult) {
-				std::cout << __FILE__ << ":" << __LINE__ << ": Failed self test on i=" << i << std::endl;
+				std::cout << __FILE__ << ":" << __LINE__ << ": Failed self test on " << kernels.name << " i=" << i << std::endl;
 			} else {
-				std::cout << __FILE__ << ":" << __LINE__ << ": Passed self test on i=" << i << std::endl;
+				std::cout << __FILE__ << ":" << __LINE__ << ": Passed self test on " << kernels.name << " i=" << i << std::endl;
 			}
 		}
 
 		for (int i = 0; i < ctx.size(); i++) {
-			cryptonight_free_ctx(ctx[i]);
+			cryptonight_pool::inst().release(ctx[i]);
 		}
 
 		if(!bResult) {
@@ -185,4 +211,179 @@ namespace minethed_self_test {
 		return bResult;
 
 	}
+
+	bool test_random_lanes() {
+		std::array<cryptonight_ctx *, MAX_N> ctx;
+		ctx.fill(nullptr);
+
+		for (int i = 0; i < ctx.size(); i++) {
+			if ((ctx[i] = cryptonight_pool::inst().acquire(-1, minethd_alloc_ctx)) == nullptr) {
+				for (int j = 0; j < i; j++) {
+					cryptonight_pool::inst().release(ctx[j]);
+				}
+				return false;
+			}
+		}
+
+		// Fixed seed so a failure is reproducible. Every lane gets its own state or blob, so a
+		// lane that reads or writes its neighbour's data in the multi-buffer Keccak, the
+		// interleaved explode / implode or the N-way main loops fails here even when the same
+		// input in every lane would still hash right.
+		const xmrstak::cpu::cpu_features features = xmrstak::cpu::get_cpu_features();
+		std::mt19937_64 rng(0x5eed);
+		bool bResult = true;
+
+		for (int level = 0; level < cn_isa_count; level++) {
+			if (!xmrstak::cpu::cn_kernels_supported(features, (cn_isa_level)level)) {
+				continue;
+			}
+			const cn_kernels& kernels = cn_get_kernels((cn_isa_level)level);
+
+			// keccakf_multi against keccakf on n different states
+			for (size_t n = 1; n <= MAX_N; n++) {
+				uint64_t st[MAX_N][25], ref[MAX_N][25];
+				uint64_t* pSt[MAX_N];
+				for (size_t i = 0; i < n; i++) {
+					for (auto& w : st[i]) {
+						w = rng();
+					}
+					memcpy(ref[i], st[i], sizeof(st[i]));
+					kernels.keccakf(ref[i], 24);
+					pSt[i] = st[i];
+				}
+				kernels.keccakf_multi(pSt, n, 24);
+				for (size_t i = 0; i < n; i++) {
+					if (memcmp(st[i], ref[i], sizeof(st[i])) != 0) {
+						std::cout << __FILE__ << ":" << __LINE__ << ": Failed keccakf multi on " << kernels.name << " n=" << n << " lane=" << i << std::endl;
+						bResult = false;
+					}
+				}
+			}
+
+			// Each N-way hash and hash_target on N different blobs against the 1-way hash per
+			// lane. The target is lane N / 2's word 3, so the mask has set and clear bits.
+			// i = SOFT_AES << 1 | PREFETCH
+			for (int i = features.aes ? 0 : 2; i < 4; i++) {
+				uint8_t in[76 * MAX_N], ref[32 * MAX_N];
+				for (auto& b : in) {
+					b = (uint8_t)rng();
+				}
+				for (size_t lane = 0; lane < MAX_N; lane++) {
+					kernels.hash[i >> 1][0][0](in + 76 * lane, 76, ref + 32 * lane, &ctx[0]);
+				}
+
+				for (size_t n = 1; n <= MAX_N; n++) {
+					const uint64_t target = ((const uint64_t*)(ref + 32 * (n / 2)))[3];
+					uint32_t mask = 0;
+					for (size_t lane = 0; lane < n; lane++) {
+						if (((const uint64_t*)(ref + 32 * lane))[3] < target) {
+							mask |= 1u << lane;
+						}
+					}
+
+					// The asm main loops take the place of the hardware AES plain ones
+					const bool bAsm = i == 0 && n <= CN_ASM_MULTIWAY;
+					const cn_hash_fun_multi hashf = kernels.hash[i >> 1][i & 1][n - 1];
+					const cn_hash_fun_target hashf_target = kernels.hash_target[i >> 1][i & 1][n - 1];
+					for (int a = 0; a < (bAsm ? 2 : 1); a++) {
+						uint8_t out[32 * MAX_N];
+						(a ? kernels.hash_asm[n - 1] : hashf)(in, 76, out, &ctx[0]);
+						bool bLanes = memcmp(out, ref, 32 * n) == 0;
+
+						memset(out, 0xAA, sizeof(out));
+						const uint32_t hit = (a ? kernels.hash_asm_target[n - 1] : hashf_target)(in, 76, target, out, &ctx[0]);
+						bool bTarget = hit == mask;
+						for (size_t lane = 0; lane < n; lane++) {
+							const uint8_t* o = out + 32 * lane;
+							bTarget &= (mask >> lane) & 1 ? memcmp(o, ref + 32 * lane, 32) == 0 : o[0] == 0xAA && memcmp(o, o + 1, 31) == 0;
+						}
+
+						if (!bLanes || !bTarget) {
+							std::cout << __FILE__ << ":" << __LINE__ << ": Failed random lanes on " << kernels.name << " i=" << i << (a ? " asm" : "") << " n=" << n
+								<< (bLanes ? "" : " hash") << (bTarget ? "" : " hash_target") << std::endl;
+							bResult = false;
+						}
+					}
+				}
+			}
+		}
+
+		for (int i = 0; i < ctx.size(); i++) {
+			cryptonight_pool::inst().release(ctx[i]);
+		}
+
+		if(!bResult) {
+			std::cout << __FILE__ << ":" << __LINE__ << ": Random lane self-test failed" << std::endl;
+		} else {
+			std::cout << __FILE__ << ":" << __LINE__ << ": Random lane self-test passed" << std::endl;
+		}
+
+		return bResult;
+	}
+
+	bool test_extra_hashes() {
+		static const char* names[4] = {"blake", "groestl", "jh", "skein"};
+		const xmrstak::cpu::cpu_features features = xmrstak::cpu::get_cpu_features();
+
+		// Fixed seed so a failure is reproducible. The lengths cover the empty input, both sides
+		// of every padding boundary of the 64 byte blocks and the 200 byte keccak state the
+		// miner actually passes in. The multi-buffer versions get MAX_N different inputs, at
+		// 200 bytes for every n and otherwise for one n per length.
+		std::mt19937 rng(0x5eed);
+		std::vector<uint8_t> in(512 * MAX_N);
+		bool bResult = true;
+
+		for (int level = 0; level < cn_isa_count; level++) {
+			if (!xmrstak::cpu::cn_kernels_supported(features, (cn_isa_level)level)) {
+				continue;
+			}
+			const cn_kernels& kernels = cn_get_kernels((cn_isa_level)level);
+
+			for (size_t len = 0; len <= 512; len += len < 260 ? 1 : 61) {
+				for (auto& b : in) {
+					b = (uint8_t)rng();
+				}
+				for (int f = 0; f < 4; f++) {
+					uint8_t out[32], ref[32];
+					kernels.extra_hashes[f](in.data(), len, out);
+					kernels.extra_hashes_ref[f](in.data(), len, ref);
+					if (memcmp(out, ref, sizeof(out)) != 0) {
+						std::cout << __FILE__ << ":" << __LINE__ << ": Failed " << names[f] << " on " << kernels.name << " len=" << len << std::endl;
+						bResult = false;
+					}
+				}
+
+				for (size_t n = 1; n <= MAX_N; n++) {
+					if (len != 200 && n != len % MAX_N + 1) {
+						continue;
+					}
+					const uint8_t* pIn[MAX_N];
+					uint8_t* pOut[MAX_N];
+					uint8_t out[32 * MAX_N], ref[32];
+					for (size_t i = 0; i < n; i++) {
+						pIn[i] = in.data() + 512 * i;
+						pOut[i] = out + 32 * i;
+					}
+					for (int f = 0; f < 4; f++) {
+						kernels.extra_hashes_multi[f](pIn, len, pOut, n);
+						for (size_t i = 0; i < n; i++) {
+							kernels.extra_hashes_ref[f](pIn[i], len, ref);
+							if (memcmp(pOut[i], ref, sizeof(ref)) != 0) {
+								std::cout << __FILE__ << ":" << __LINE__ << ": Failed " << names[f] << " multi on " << kernels.name << " len=" << len << " n=" << n << " lane=" << i << std::endl;
+								bResult = false;
+							}
+						}
+					}
+				}
+			}
+		}
+
+		if(!bResult) {
+			std::cout << __FILE__ << ":" << __LINE__ << ": Finalizer hash self-test failed" << std::endl;
+		} else {
+			std::cout << __FILE__ << ":" << __LINE__ << ": Finalizer hash self-test passed" << std::endl;
+		}
+
+		return bResult;
+	}
 }
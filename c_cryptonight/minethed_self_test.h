@@ -9,6 +9,10 @@
 namespace minethed_self_test {
 	bool test_func_selector();
 	bool test_func_multi_selector();
+	// keccakf_multi and every N-way hash / hash_target on different random lanes against 1-way
+	bool test_random_lanes();
+	// SIMD and multi-buffer blake, groestl, jh and skein against the C versions on random input
+	bool test_extra_hashes();
 }
 
 #endif //XMR_STAK_MINETHED_SELF_TEST_H
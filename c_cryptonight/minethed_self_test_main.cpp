@@ -5,5 +5,6 @@
 #include "minethed_self_test.h"
 
 int main() {
-	return minethed_self_test::test_func_selector() && minethed_self_test::test_func_multi_selector();
+	return minethed_self_test::test_func_selector() && minethed_self_test::test_func_multi_selector() &&
+		minethed_self_test::test_random_lanes() && minethed_self_test::test_extra_hashes();
 }
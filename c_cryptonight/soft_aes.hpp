@@ -85,7 +85,8 @@
 alignas(16) const uint32_t saes_table[4][256] = { saes_data(saes_u0), saes_data(saes_u1), saes_data(saes_u2), saes_data(saes_u3) };
 alignas(16) const uint8_t  saes_sbox[256] = saes_data(saes_h0);
 
-static inline __m128i soft_aesenc(__m128i in, __m128i key)
+// The saes_table version, the only one without SSSE3
+static inline __m128i soft_aesenc_table(__m128i in, __m128i key)
 {
 	uint32_t x0, x1, x2, x3;
 	x0 = _mm_cvtsi128_si32(in);
@@ -102,6 +103,69 @@ static inline __m128i soft_aesenc(__m128i in, __m128i key)
 	return _mm_xor_si128(out, key);
 }
 
+#if defined(__SSSE3__)
+// Constant time AES with SSSE3, after M. Hamburg, "Accelerating AES with vector permute
+// instructions". Every byte goes through a change of basis into GF((2^4)^2), where the
+// inverse needs only 4 bit lookups, and a second change of basis that also applies the
+// S-box affine map. Each lookup is one pshufb of a 16 byte table, so unlike saes_table
+// nothing depends on the data but the values. The tables compute S(x) ^ 0x63; MixColumns
+// maps a 0x63 in every byte to itself, so the constant is added back with the round key.
+alignas(16) const uint8_t saes_vp_tables[6][16] = {
+	{ 0x00, 0x70, 0x2a, 0x5a, 0x98, 0xe8, 0xb2, 0xc2, 0x08, 0x78, 0x22, 0x52, 0x90, 0xe0, 0xba, 0xca },	// input transform, low nibble
+	{ 0x00, 0x4d, 0x7c, 0x31, 0x7d, 0x30, 0x01, 0x4c, 0x81, 0xcc, 0xfd, 0xb0, 0xfc, 0xb1, 0x80, 0xcd },	// input transform, high nibble
+	{ 0x80, 0x01, 0x08, 0x0d, 0x0f, 0x06, 0x05, 0x0e, 0x02, 0x0c, 0x0b, 0x0a, 0x09, 0x03, 0x07, 0x04 },	// 1/x in GF(2^4)
+	{ 0x80, 0x07, 0x0b, 0x0f, 0x06, 0x0a, 0x04, 0x01, 0x09, 0x08, 0x05, 0x02, 0x0c, 0x0e, 0x0d, 0x03 },	// a/x
+	{ 0x00, 0xc7, 0xbd, 0x6f, 0x17, 0x6d, 0xd2, 0xd0, 0x78, 0xa8, 0x02, 0xc5, 0x7a, 0xbf, 0xaa, 0x15 },	// output transform, io
+	{ 0x00, 0x6a, 0xbb, 0x5f, 0xa5, 0x74, 0xe4, 0xcf, 0xfa, 0x35, 0x2b, 0x41, 0xd1, 0x90, 0x1e, 0x8e } };	// output transform, jo
+
+// SubBytes of all 16 bytes, without the 0x63
+static inline __m128i soft_aes_subbytes_63(__m128i x)
+{
+	const __m128i* t = (const __m128i*)saes_vp_tables;
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i inv = _mm_load_si128(t + 2);
+	const __m128i inva = _mm_load_si128(t + 3);
+
+	x = _mm_xor_si128(_mm_shuffle_epi8(_mm_load_si128(t + 0), _mm_and_si128(x, mask)),
+		_mm_shuffle_epi8(_mm_load_si128(t + 1), _mm_and_si128(_mm_srli_epi32(x, 4), mask)));
+
+	const __m128i i = _mm_and_si128(_mm_srli_epi32(x, 4), mask);
+	const __m128i k = _mm_and_si128(x, mask);
+	const __m128i j = _mm_xor_si128(i, k);
+	const __m128i ak = _mm_shuffle_epi8(inva, k);
+	const __m128i iak = _mm_xor_si128(_mm_shuffle_epi8(inv, i), ak);
+	const __m128i jak = _mm_xor_si128(_mm_shuffle_epi8(inv, j), ak);
+	const __m128i io = _mm_xor_si128(_mm_shuffle_epi8(inv, iak), j);
+	const __m128i jo = _mm_xor_si128(_mm_shuffle_epi8(inv, jak), i);
+
+	return _mm_xor_si128(_mm_shuffle_epi8(_mm_load_si128(t + 4), io), _mm_shuffle_epi8(_mm_load_si128(t + 5), jo));
+}
+
+static inline __m128i soft_aesenc(__m128i in, __m128i key)
+{
+	// ShiftRows, and ShiftRows followed by rotating every column up by one byte
+	const __m128i sr = _mm_setr_epi8(0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11);
+	const __m128i sr1 = _mm_setr_epi8(5, 10, 15, 0, 9, 14, 3, 4, 13, 2, 7, 8, 1, 6, 11, 12);
+	const __m128i rot2 = _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+
+	const __m128i x = soft_aes_subbytes_63(in);
+	const __m128i s = _mm_shuffle_epi8(x, sr);
+	const __m128i r1 = _mm_shuffle_epi8(x, sr1);
+
+	// MixColumns, out[i] = 2 (s[i] ^ s[i+1]) ^ s[i+1] ^ s[i+2] ^ s[i+3]
+	const __m128i t = _mm_xor_si128(s, r1);
+	const __m128i t2 = _mm_xor_si128(_mm_add_epi8(t, t), _mm_and_si128(_mm_cmpgt_epi8(_mm_setzero_si128(), t), _mm_set1_epi8(0x1b)));
+	const __m128i out = _mm_xor_si128(_mm_xor_si128(t2, r1), _mm_shuffle_epi8(t, rot2));
+
+	return _mm_xor_si128(out, _mm_xor_si128(key, _mm_set1_epi8(0x63)));
+}
+#else
+static inline __m128i soft_aesenc(__m128i in, __m128i key)
+{
+	return soft_aesenc_table(in, key);
+}
+#endif
+
 static inline uint32_t sub_word(uint32_t key)
 {
 	return (saes_sbox[key >> 24 ] << 24)   | 
@@ -119,7 +183,14 @@ static inline uint32_t _rotr(uint32_t value, uint32_t amount)
 
 static inline __m128i soft_aeskeygenassist(__m128i key, uint8_t rcon)
 {
+#if defined(__SSSE3__)
+	// words 1 and 3 through the S-box, each once as is and once rotated right by 8 bits
+	const __m128i words = _mm_setr_epi8(4, 5, 6, 7, 5, 6, 7, 4, 12, 13, 14, 15, 13, 14, 15, 12);
+	const __m128i x = _mm_shuffle_epi8(soft_aes_subbytes_63(key), words);
+	return _mm_xor_si128(x, _mm_xor_si128(_mm_set1_epi8(0x63), _mm_set_epi32(rcon, 0, rcon, 0)));
+#else
 	uint32_t X1 = sub_word(_mm_cvtsi128_si32(_mm_shuffle_epi32(key, 0x55)));
 	uint32_t X3 = sub_word(_mm_cvtsi128_si32(_mm_shuffle_epi32(key, 0xFF)));
 	return _mm_set_epi32(_rotr(X3, 8) ^ rcon, X3,_rotr(X1, 8) ^ rcon, X1);
+#endif
 }
@@ -24,6 +24,16 @@ namespace c_groestl {
     };
 
     void groestl(const BitSequence *, DataLength, BitSequence *);
+
+#if defined(__AES__) && defined(__SSSE3__)
+    /* byte aligned input, AES-NI and SSSE3 builds only (c_groestl_aesni.cpp) */
+    void groestl_aesni(const BitSequence *, size_t, BitSequence *);
+#endif
+
+#if defined(__VAES__) && defined(__AVX2__)
+    /* two messages of the same length, one per 128 bit lane, VAES builds only */
+    void groestl_vaes_x2(const BitSequence *const data[2], size_t len, BitSequence *const hashval[2]);
+#endif
 }
 
 #endif //MONERO_CPU_MINER_GROESTL_GROESTL_H
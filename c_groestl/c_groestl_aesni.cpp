@@ -0,0 +1,264 @@
+/* Groestl-256 with AES-NI and SSSE3, and VAES for two messages at once
+ *
+ * Same function as c_groestl.cpp, built for the hash kernels that have
+ * AES-NI and SSSE3. The state is kept row-wise, one 128 bit register per
+ * row with P in the low and Q in the high eight bytes, so both permutations
+ * of the compression function run in the same instructions:
+ *
+ *   SubBytes    aesenclast with a zero key, i.e. ShiftRows(SubBytes(x))
+ *   ShiftBytes  one pshufb per row that also undoes the AES ShiftRows
+ *   MixBytes    xtime and xor on whole rows
+ *
+ * Message blocks and the final state are transposed between the byte order
+ * of the specification (column by column) and rows with unpack instructions.
+ * Nothing crosses a 128 bit lane, so with VAES the same code on 256 bit
+ * registers hashes two messages, one per lane.
+ */
+
+#include "c_groestl.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace c_groestl {
+
+	struct groestl_row_masks {
+		uint8_t m[8][16];
+	};
+
+	/* ShiftBytes of row i composed with the inverse of the AES ShiftRows done by aesenclast */
+	static constexpr groestl_row_masks make_groestl_row_masks() {
+		const uint8_t inv_shift_rows[16] = {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3};
+		const uint8_t shift_p[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+		const uint8_t shift_q[8] = {1, 3, 5, 7, 0, 2, 4, 6};
+		groestl_row_masks r = {};
+		for (int i = 0; i < 8; i++) {
+			for (int j = 0; j < 8; j++) {
+				r.m[i][j] = inv_shift_rows[(j + shift_p[i]) % 8];
+				r.m[i][j + 8] = inv_shift_rows[8 + (j + shift_q[i]) % 8];
+			}
+		}
+		return r;
+	}
+
+	alignas(16) static constexpr groestl_row_masks groestl_masks = make_groestl_row_masks();
+
+	/* the operations of the rounds, overloaded on the register width */
+	static inline __m128i gr_xor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+	static inline __m128i gr_xtime(__m128i x) {
+		const __m128i carry = _mm_cmpgt_epi8(_mm_setzero_si128(), x);
+		return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(carry, _mm_set1_epi8(0x1b)));
+	}
+	static inline __m128i gr_sub_shift(__m128i x, int row) {
+		return _mm_shuffle_epi8(_mm_aesenclast_si128(x, _mm_setzero_si128()), _mm_load_si128((const __m128i *) groestl_masks.m[row]));
+	}
+	static inline __m128i gr_unpacklo8(__m128i a, __m128i b) { return _mm_unpacklo_epi8(a, b); }
+	static inline __m128i gr_unpacklo16(__m128i a, __m128i b) { return _mm_unpacklo_epi16(a, b); }
+	static inline __m128i gr_unpackhi16(__m128i a, __m128i b) { return _mm_unpackhi_epi16(a, b); }
+	static inline __m128i gr_unpacklo32(__m128i a, __m128i b) { return _mm_unpacklo_epi32(a, b); }
+	static inline __m128i gr_unpackhi32(__m128i a, __m128i b) { return _mm_unpackhi_epi32(a, b); }
+	static inline __m128i gr_unpacklo64(__m128i a, __m128i b) { return _mm_unpacklo_epi64(a, b); }
+	static inline __m128i gr_unpackhi64(__m128i a, __m128i b) { return _mm_unpackhi_epi64(a, b); }
+	static inline __m128i gr_hi8(__m128i a) { return _mm_srli_si128(a, 8); }
+	static inline void gr_set(__m128i &v, uint64_t hi, uint64_t lo) { v = _mm_set_epi64x(hi, lo); }
+
+#if defined(__VAES__) && defined(__AVX2__)
+	static inline __m256i gr_xor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+	static inline __m256i gr_xtime(__m256i x) {
+		const __m256i carry = _mm256_cmpgt_epi8(_mm256_setzero_si256(), x);
+		return _mm256_xor_si256(_mm256_add_epi8(x, x), _mm256_and_si256(carry, _mm256_set1_epi8(0x1b)));
+	}
+	static inline __m256i gr_sub_shift(__m256i x, int row) {
+		return _mm256_shuffle_epi8(_mm256_aesenclast_epi128(x, _mm256_setzero_si256()),
+			_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) groestl_masks.m[row])));
+	}
+	static inline __m256i gr_unpacklo8(__m256i a, __m256i b) { return _mm256_unpacklo_epi8(a, b); }
+	static inline __m256i gr_unpacklo16(__m256i a, __m256i b) { return _mm256_unpacklo_epi16(a, b); }
+	static inline __m256i gr_unpackhi16(__m256i a, __m256i b) { return _mm256_unpackhi_epi16(a, b); }
+	static inline __m256i gr_unpacklo32(__m256i a, __m256i b) { return _mm256_unpacklo_epi32(a, b); }
+	static inline __m256i gr_unpackhi32(__m256i a, __m256i b) { return _mm256_unpackhi_epi32(a, b); }
+	static inline __m256i gr_unpacklo64(__m256i a, __m256i b) { return _mm256_unpacklo_epi64(a, b); }
+	static inline __m256i gr_unpackhi64(__m256i a, __m256i b) { return _mm256_unpackhi_epi64(a, b); }
+	static inline __m256i gr_hi8(__m256i a) { return _mm256_srli_si256(a, 8); }
+	static inline void gr_set(__m256i &v, uint64_t hi, uint64_t lo) { v = _mm256_set_epi64x(hi, lo, hi, lo); }
+#endif
+
+	/* 8x8 byte transpose, a..d hold two 8 byte lines each, low half first */
+	template<typename V>
+	static inline void groestl_transpose(V &a, V &b, V &c, V &d) {
+		V t0 = gr_unpacklo8(a, gr_hi8(a));
+		V t1 = gr_unpacklo8(b, gr_hi8(b));
+		V t2 = gr_unpacklo8(c, gr_hi8(c));
+		V t3 = gr_unpacklo8(d, gr_hi8(d));
+		V u0 = gr_unpacklo16(t0, t1);
+		V u1 = gr_unpackhi16(t0, t1);
+		V u2 = gr_unpacklo16(t2, t3);
+		V u3 = gr_unpackhi16(t2, t3);
+		a = gr_unpacklo32(u0, u2);
+		b = gr_unpackhi32(u0, u2);
+		c = gr_unpacklo32(u1, u3);
+		d = gr_unpackhi32(u1, u3);
+	}
+
+	/* ten rounds of P on the low and Q on the high half of every row */
+	template<typename V>
+	static inline void groestl_rounds(V r[8]) {
+		V q_ones;
+		gr_set(q_ones, ~0ULL, 0);
+
+		for (int round = 0; round < 10; round++) {
+			const uint64_t rnd = 0x0101010101010101ULL * round;
+			V c0, c7;
+			gr_set(c0, ~0ULL, 0x7060504030201000ULL ^ rnd);
+			gr_set(c7, 0x7060504030201000ULL ^ ~0ULL ^ rnd, 0);
+
+			/* AddRoundConstant */
+			r[0] = gr_xor(r[0], c0);
+			for (int i = 1; i < 7; i++)
+				r[i] = gr_xor(r[i], q_ones);
+			r[7] = gr_xor(r[7], c7);
+
+			/* SubBytes and ShiftBytes */
+			for (int i = 0; i < 8; i++)
+				r[i] = gr_sub_shift(r[i], i);
+
+			/* MixBytes with the circulant (02 02 03 04 05 03 05 07), row i of the
+			 * result is the sum over t of coefficient t times row i + t */
+			V x2[8], x4[8];
+			for (int i = 0; i < 8; i++) {
+				x2[i] = gr_xtime(r[i]);
+				x4[i] = gr_xtime(x2[i]);
+			}
+
+			V y[8];
+			for (int i = 0; i < 8; i++) {
+				const int i1 = (i + 1) & 7, i2 = (i + 2) & 7, i3 = (i + 3) & 7, i4 = (i + 4) & 7;
+				const int i5 = (i + 5) & 7, i6 = (i + 6) & 7, i7 = (i + 7) & 7;
+				V s1 = gr_xor(gr_xor(r[i2], r[i4]), gr_xor(gr_xor(r[i5], r[i6]), r[i7]));
+				V s2 = gr_xor(gr_xor(x2[i], x2[i1]), gr_xor(gr_xor(x2[i2], x2[i5]), x2[i7]));
+				V s4 = gr_xor(gr_xor(x4[i3], x4[i4]), gr_xor(x4[i6], x4[i7]));
+				y[i] = gr_xor(gr_xor(s1, s2), s4);
+			}
+			for (int i = 0; i < 8; i++)
+				r[i] = y[i];
+		}
+	}
+
+	/* h <- P(h ^ m) ^ Q(m) ^ h, h and m in rows (two per register) */
+	template<typename V>
+	static inline void groestl_compress(V h[4], V m0, V m1, V m2, V m3) {
+		groestl_transpose(m0, m1, m2, m3);
+		const V m[4] = {m0, m1, m2, m3};
+
+		V r[8];
+		for (int k = 0; k < 4; k++) {
+			const V p = gr_xor(h[k], m[k]);
+			r[2 * k] = gr_unpacklo64(p, m[k]);
+			r[2 * k + 1] = gr_unpackhi64(p, m[k]);
+		}
+
+		groestl_rounds(r);
+
+		for (int k = 0; k < 4; k++) {
+			const V pq = gr_xor(gr_unpacklo64(r[2 * k], r[2 * k + 1]), gr_unpackhi64(r[2 * k], r[2 * k + 1]));
+			h[k] = gr_xor(h[k], pq);
+		}
+	}
+
+	/* initial value: all zero but the output size in the last column, in rows */
+	template<typename V>
+	static inline void groestl_init(V h[4]) {
+		gr_set(h[0], 0, 0);
+		gr_set(h[1], 0, 0);
+		gr_set(h[2], 0, 0);
+		gr_set(h[3], 0x0001000000000000ULL, 0);
+		groestl_transpose(h[0], h[1], h[2], h[3]);
+	}
+
+	/* output transformation h <- P(h) ^ h, the Q half of the rounds is ignored, and
+	 * the last 256 bits in column order */
+	template<typename V>
+	static inline void groestl_final(V h[4]) {
+		V r[8];
+		for (int k = 0; k < 4; k++) {
+			r[2 * k] = gr_unpacklo64(h[k], h[k]);
+			r[2 * k + 1] = gr_unpackhi64(h[k], h[k]);
+		}
+		groestl_rounds(r);
+		for (int k = 0; k < 4; k++)
+			h[k] = gr_xor(h[k], gr_unpacklo64(r[2 * k], r[2 * k + 1]));
+		groestl_transpose(h[0], h[1], h[2], h[3]);
+	}
+
+	/* pad with a 1 bit, zeros and the big endian number of blocks, returns the number of
+	 * blocks written to buf */
+	static inline size_t groestl_pad(uint8_t buf[2 * SIZE512], const BitSequence *data, size_t len) {
+		const size_t full = len / SIZE512;
+		const size_t rem = len - full * SIZE512;
+		const size_t pad_blocks = rem + 1 + LENGTHFIELDLEN <= SIZE512 ? 1 : 2;
+		uint64_t blocks = full + pad_blocks;
+		memset(buf, 0, 2 * SIZE512);
+		memcpy(buf, data + full * SIZE512, rem);
+		buf[rem] = 0x80;
+		for (int i = 1; i <= LENGTHFIELDLEN; i++, blocks >>= 8)
+			buf[pad_blocks * SIZE512 - i] = (uint8_t) blocks;
+		return pad_blocks;
+	}
+
+	static inline void groestl_compress_block(__m128i h[4], const uint8_t *block) {
+		const __m128i *b = (const __m128i *) block;
+		groestl_compress(h, _mm_loadu_si128(b), _mm_loadu_si128(b + 1), _mm_loadu_si128(b + 2), _mm_loadu_si128(b + 3));
+	}
+
+/* hash len bytes, byte aligned input only */
+	void groestl_aesni(const BitSequence *data, size_t len, BitSequence *hashval) {
+		uint8_t buf[2 * SIZE512];
+		__m128i h[4];
+
+		groestl_init(h);
+
+		const size_t full = len / SIZE512;
+		for (size_t i = 0; i < full; i++)
+			groestl_compress_block(h, data + i * SIZE512);
+
+		const size_t pad_blocks = groestl_pad(buf, data, len);
+		for (size_t i = 0; i < pad_blocks; i++)
+			groestl_compress_block(h, buf + i * SIZE512);
+
+		groestl_final(h);
+		_mm_storeu_si128((__m128i *) hashval, h[2]);
+		_mm_storeu_si128((__m128i *) (hashval + 16), h[3]);
+	}
+
+#if defined(__VAES__) && defined(__AVX2__)
+	static inline void groestl_compress_block(__m256i h[4], const uint8_t *block0, const uint8_t *block1) {
+		const __m128i *b0 = (const __m128i *) block0;
+		const __m128i *b1 = (const __m128i *) block1;
+		groestl_compress(h, _mm256_loadu2_m128i(b1, b0), _mm256_loadu2_m128i(b1 + 1, b0 + 1),
+			_mm256_loadu2_m128i(b1 + 2, b0 + 2), _mm256_loadu2_m128i(b1 + 3, b0 + 3));
+	}
+
+/* two messages of len bytes, message j in lane j */
+	void groestl_vaes_x2(const BitSequence *const data[2], size_t len, BitSequence *const hashval[2]) {
+		uint8_t buf[2][2 * SIZE512];
+		__m256i h[4];
+
+		groestl_init(h);
+
+		const size_t full = len / SIZE512;
+		for (size_t i = 0; i < full; i++)
+			groestl_compress_block(h, data[0] + i * SIZE512, data[1] + i * SIZE512);
+
+		groestl_pad(buf[0], data[0], len);
+		const size_t pad_blocks = groestl_pad(buf[1], data[1], len);
+		for (size_t i = 0; i < pad_blocks; i++)
+			groestl_compress_block(h, buf[0] + i * SIZE512, buf[1] + i * SIZE512);
+
+		groestl_final(h);
+		_mm256_storeu2_m128i((__m128i *) hashval[1], (__m128i *) hashval[0], h[2]);
+		_mm256_storeu2_m128i((__m128i *) (hashval[1] + 16), (__m128i *) (hashval[0] + 16), h[3]);
+	}
+#endif
+}
@@ -6,5 +6,22 @@
 #include "c_groestl.hpp"
 
 void do_groestl_hash(const uint8_t* input, std::size_t len, uint8_t* output) {
+#if defined(__AES__) && defined(__SSSE3__)
+	c_groestl::groestl_aesni(input, len, output);
+#else
 	c_groestl::groestl(input, len * 8, output);
+#endif
+}
+
+void do_groestl_hash_ref(const uint8_t* input, std::size_t len, uint8_t* output) {
+	c_groestl::groestl(input, len * 8, output);
+}
+
+void do_groestl_hash_multi(const uint8_t* const input[], std::size_t len, uint8_t* const output[], std::size_t n) {
+#if defined(__VAES__) && defined(__AVX2__)
+	for (; n >= 2; n -= 2, input += 2, output += 2)
+		c_groestl::groestl_vaes_x2(input, len, output);
+#endif
+	for (std::size_t i = 0; i < n; i++)
+		do_groestl_hash(input[i], len, output[i]);
 }
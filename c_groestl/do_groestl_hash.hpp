@@ -10,4 +10,10 @@
 
 void do_groestl_hash(const uint8_t* input, std::size_t len, uint8_t* output);
 
+// the portable reference implementation, do_groestl_hash may use a SIMD one
+void do_groestl_hash_ref(const uint8_t* input, std::size_t len, uint8_t* output);
+
+// n inputs of len bytes into n 32 byte outputs, several at once where the kernel has SIMD for it
+void do_groestl_hash_multi(const uint8_t* const input[], std::size_t len, uint8_t* const output[], std::size_t n);
+
 #endif //MONERO_CPU_MINER_GROESTL_HASH_H
@@ -0,0 +1,254 @@
+#include "hwlocArena.hpp"
+#include "hwlocTopology.hpp"
+#include <iostream>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <fstream>
+#include <string>
+#endif
+
+hwlocArena& hwlocArena::inst() {
+	// Never destroyed, like the topology, mining threads keep their slices until exit
+	static hwlocArena* instance = new hwlocArena();
+	return *instance;
+}
+
+const char* hwlocArena::tierName(page_tier tier) {
+	static const char* const names[page_tier_count] = {"1 GiB", "2 MiB", "transparent huge", "4 KiB"};
+	return tier < page_tier_count ? names[tier] : "unknown";
+}
+
+#if defined(__linux__)
+static const size_t hugePageSize = 2u * 1024u * 1024u;
+static const size_t giganticPageSize = 1024u * 1024u * 1024u;
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+/** anonymous mapping aligned to hugePageSize, nullptr on failure */
+static uint8_t* mapRegion(size_t size, hwlocArena::page_tier tier) {
+	if(tier == hwlocArena::pages_1g || tier == hwlocArena::pages_2m) {
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+		if(tier == hwlocArena::pages_1g)
+			flags |= MAP_HUGE_1GB;
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		return ptr == MAP_FAILED ? nullptr : (uint8_t*)ptr;
+	}
+
+	// Over-map and trim, so every slice starts on a 2 MiB boundary like the _mm_malloc path
+	void* ptr = mmap(nullptr, size + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ptr == MAP_FAILED)
+		return nullptr;
+
+	uint8_t* raw = (uint8_t*)ptr;
+	uint8_t* base = (uint8_t*)(((uintptr_t)raw + hugePageSize - 1) & ~(uintptr_t)(hugePageSize - 1));
+	if(base != raw)
+		munmap(raw, base - raw);
+	munmap(base + size, raw + hugePageSize - base);
+
+	if(tier == hwlocArena::pages_thp && madvise(base, size, MADV_HUGEPAGE) != 0) {
+		munmap(base, size);
+		return nullptr;
+	}
+	return base;
+}
+
+static bool bindRegion(uint8_t* base, size_t size, int node) {
+	hwlocTopology& topo = hwlocTopology::inst();
+	hwloc_const_nodeset_t nodeset = topo.nodesetOfNode(node);
+	if(nodeset == nullptr)
+		return false;
+
+#if HWLOC_API_VERSION >= 0x00020000
+	return hwloc_set_area_membind(topo.handle(), base, size, nodeset, HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_BYNODESET | HWLOC_MEMBIND_STRICT) == 0;
+#else
+	return hwloc_set_area_membind_nodeset(topo.handle(), base, size, nodeset, HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_STRICT) == 0;
+#endif
+}
+
+/** free pages of a huge page tier on a NUMA node as the kernel reports them, -1 if unknown */
+static long freeHugePages(int node, hwlocArena::page_tier tier) {
+	hwlocTopology& topo = hwlocTopology::inst();
+	if(topo.handle() == nullptr)
+		return -1;
+	hwloc_obj_t obj = hwloc_get_obj_by_type(topo.handle(), HWLOC_OBJ_NUMANODE, node);
+	if(obj == nullptr)
+		return -1;
+
+	const char* kb = tier == hwlocArena::pages_1g ? "1048576" : "2048";
+	std::ifstream in("/sys/devices/system/node/node" + std::to_string(obj->os_index) + "/hugepages/hugepages-" + kb + "kB/free_hugepages");
+	long pages = -1;
+	if(!(in >> pages))
+		return -1;
+	return pages;
+}
+
+/** write every page from a thread bound to the node, so the pages are local even if the membind failed */
+static void touchRegion(uint8_t* base, size_t size, size_t pageSize, int node) {
+	hwlocTopology& topo = hwlocTopology::inst();
+	hwloc_obj_t obj = topo.handle() == nullptr ? nullptr : hwloc_get_obj_by_type(topo.handle(), HWLOC_OBJ_NUMANODE, node);
+	hwloc_bitmap_t old = hwloc_bitmap_alloc();
+	const bool rebind = obj != nullptr && obj->cpuset != nullptr && hwloc_get_cpubind(topo.handle(), old, HWLOC_CPUBIND_THREAD) == 0 &&
+		hwloc_set_cpubind(topo.handle(), obj->cpuset, HWLOC_CPUBIND_THREAD) == 0;
+
+	for(size_t i = 0; i < size; i += pageSize)
+		base[i] = 0;
+
+	if(rebind)
+		hwloc_set_cpubind(topo.handle(), old, HWLOC_CPUBIND_THREAD);
+	hwloc_bitmap_free(old);
+}
+
+/** fault every page in, false if the node has no pages left
+ *
+ * Touching a huge page the node cannot supply raises SIGBUS, so huge page
+ * regions are only faulted in by calls that report the shortage instead, or
+ * by touching them once the node is known to have enough free pages.
+ */
+static bool populateRegion(uint8_t* base, size_t size, int node, hwlocArena::page_tier tier, bool lock, bool& locked) {
+	locked = false;
+
+	if(madvise(base, size, MADV_POPULATE_WRITE) == 0) {
+		locked = lock && mlock(base, size) == 0;
+		return true;
+	}
+	if(errno != EINVAL)
+		return false;
+
+	// Kernels before 5.14, mlock faults the pages in and fails with ENOMEM on a shortage
+	if(mlock(base, size) == 0) {
+		if(lock)
+			locked = true;
+		else
+			munlock(base, size);
+		return true;
+	}
+
+	const bool hugetlb = tier == hwlocArena::pages_1g || tier == hwlocArena::pages_2m;
+	if(hugetlb) {
+		// Without CAP_IPC_LOCK mlock fails on RLIMIT_MEMLOCK too, which says nothing about the
+		// node's pages. Only a real shortage rejects the tier.
+		struct rlimit lim;
+		const bool rlimited = errno == EPERM ||
+			(errno == ENOMEM && getrlimit(RLIMIT_MEMLOCK, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY && size > lim.rlim_cur);
+		const size_t pageSize = tier == hwlocArena::pages_1g ? giganticPageSize : hugePageSize;
+		const long pages = freeHugePages(node, tier);
+		if(!rlimited || pages < 0 || (size_t)pages < size / pageSize)
+			return false;
+
+		touchRegion(base, size, pageSize, node);
+		return true;
+	}
+
+	touchRegion(base, size, 4096, node);
+	return true;
+}
+#endif
+
+hwlocArena::~hwlocArena() {
+#if defined(__linux__)
+	for(auto& r : regions) {
+		if(r.locked)
+			munlock(r.base, r.size);
+		munmap(r.base, r.size);
+	}
+#endif
+}
+
+void hwlocArena::reserve(size_t sliceSize, const std::vector<size_t>& slicesPerNode, page_tier first, page_tier last, bool lock) {
+	std::lock_guard<std::mutex> lck(mtx);
+	this->sliceSize = sliceSize;
+
+#if defined(__linux__)
+	for(size_t node = 0; node < slicesPerNode.size(); node++) {
+		if(slicesPerNode[node] == 0)
+			continue;
+
+		region r;
+		r.node = node;
+		r.base = nullptr;
+		r.bound = false;
+		r.locked = false;
+
+		for(int tier = first; tier <= last; tier++) {
+			r.tier = (page_tier)tier;
+			r.size = slicesPerNode[node] * sliceSize;
+			if(r.tier == pages_1g)
+				r.size = (r.size + giganticPageSize - 1) / giganticPageSize * giganticPageSize;
+			r.slices = r.size / sliceSize;
+
+			r.base = mapRegion(r.size, r.tier);
+			if(r.base == nullptr)
+				continue;
+
+			// Bind before the first touch, otherwise the pages land wherever the caller runs
+			r.bound = bindRegion(r.base, r.size, node);
+			if(populateRegion(r.base, r.size, node, r.tier, lock, r.locked))
+				break;
+
+			munmap(r.base, r.size);
+			r.base = nullptr;
+		}
+
+		if(r.base == nullptr) {
+			std::cerr << __FILE__ << ":" << __LINE__ << ":hwloc: can't reserve " << slicesPerNode[node] << " scratchpads on NUMA node " << node << std::endl;
+			continue;
+		}
+
+		madvise(r.base, r.size, MADV_RANDOM);
+		for(size_t i = r.slices; i > 0; i--)
+			r.free.push_back(r.base + (i - 1) * sliceSize);
+		regions.push_back(std::move(r));
+	}
+#endif
+}
+
+uint8_t* hwlocArena::acquire(int node) {
+	std::lock_guard<std::mutex> lck(mtx);
+	for(auto& r : regions) {
+		if(r.node != node || r.free.empty())
+			continue;
+		uint8_t* slice = r.free.back();
+		r.free.pop_back();
+		return slice;
+	}
+	return nullptr;
+}
+
+bool hwlocArena::release(uint8_t* slice) {
+	std::lock_guard<std::mutex> lck(mtx);
+	for(auto& r : regions) {
+		if(slice >= r.base && slice < r.base + r.size) {
+			r.free.push_back(slice);
+			return true;
+		}
+	}
+	return false;
+}
+
+hwlocArena::page_tier hwlocArena::tierOf(const uint8_t* slice) const {
+	std::lock_guard<std::mutex> lck(mtx);
+	for(const auto& r : regions) {
+		if(slice >= r.base && slice < r.base + r.size)
+			return r.tier;
+	}
+	return page_tier_count;
+}
+
+std::vector<hwlocArena::node_usage> hwlocArena::usage() const {
+	std::lock_guard<std::mutex> lck(mtx);
+	std::vector<node_usage> result;
+	for(const auto& r : regions)
+		result.push_back({r.node, r.slices, r.slices - r.free.size(), r.tier, r.bound});
+	return result;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/** scratchpad memory, one region per NUMA node
+ *
+ * Each region is reserved once at startup, bound to its node with mbind before
+ * the first touch and cut into equal slices. A thread pinned on a node takes its
+ * scratchpads from that node's region, so placement no longer depends on the
+ * memory policy the thread happens to have when it allocates.
+ */
+class hwlocArena {
+public:
+	/** what backs a region, best first */
+	enum page_tier {
+		pages_1g,	// MAP_HUGETLB | MAP_HUGE_1GB, the region is rounded up to whole 1 GiB pages
+		pages_2m,	// MAP_HUGETLB with the default huge page size
+		pages_thp,	// 4 KiB pages with madvise(MADV_HUGEPAGE), the kernel may merge them
+		pages_4k,
+		page_tier_count
+	};
+
+	struct node_usage {
+		int node;		// logical index of the NUMA node
+		size_t slices;
+		size_t used;
+		page_tier tier;
+		bool bound;		// false if the region could not be bound to the node
+	};
+
+	static const char* tierName(page_tier tier);
+
+	/** the process wide arena the mining threads use */
+	static hwlocArena& inst();
+
+	hwlocArena() = default;
+	~hwlocArena();
+
+	/** map and pre-fault the regions, call once before the first acquire
+	 *
+	 * Every node gets the best tier from first to last it has pages for. A
+	 * 1 GiB region is rounded up, the extra slices are free for acquire.
+	 *
+	 * @param sliceSize bytes per slice, a multiple of 2 MiB
+	 * @param slicesPerNode slices indexed by NUMA node logical index, 0 skips the node
+	 * @param first best tier to try
+	 * @param last worst tier to fall back to
+	 * @param lock mlock the regions
+	 */
+	void reserve(size_t sliceSize, const std::vector<size_t>& slicesPerNode, page_tier first, page_tier last, bool lock);
+
+	/** a free slice on a NUMA node, nullptr if the node has none left */
+	uint8_t* acquire(int node);
+
+	/** give a slice back, false if it is not part of the arena */
+	bool release(uint8_t* slice);
+
+	/** tier of the region a slice belongs to, page_tier_count if it is not part of the arena */
+	page_tier tierOf(const uint8_t* slice) const;
+
+	std::vector<node_usage> usage() const;
+
+private:
+	struct region {
+		int node;
+		uint8_t* base;
+		size_t size;
+		size_t slices;
+		page_tier tier;
+		bool bound;
+		bool locked;
+		std::vector<uint8_t*> free;
+	};
+
+	hwlocArena(const hwlocArena&) = delete;
+	hwlocArena& operator=(const hwlocArena&) = delete;
+
+	size_t sliceSize = 0;
+	std::vector<region> regions;
+	mutable std::mutex mtx;
+};
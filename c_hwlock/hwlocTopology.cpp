@@ -0,0 +1,169 @@
+#include "hwlocTopology.hpp"
+#include <unistd.h>
+#include <iostream>
+
+static bool isL3Cache(hwloc_obj_t obj) {
+#if HWLOC_API_VERSION >= 0x00020000
+	return obj->type == HWLOC_OBJ_L3CACHE;
+#else
+	return obj->type == HWLOC_OBJ_CACHE && obj->attr->cache.depth == 3;
+#endif
+}
+
+static bool isL2Cache(hwloc_obj_t obj) {
+#if HWLOC_API_VERSION >= 0x00020000
+	return obj->type == HWLOC_OBJ_L2CACHE;
+#else
+	return obj->type == HWLOC_OBJ_CACHE && obj->attr->cache.depth == 2;
+#endif
+}
+
+hwlocTopology& hwlocTopology::inst() {
+	// Never destroyed, mining threads may still bind memory while the process exits
+	static hwlocTopology* instance = new hwlocTopology();
+	return *instance;
+}
+
+void hwlocTopology::loadFlat() {
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	if(online < 1)
+		online = 1;
+
+	topo = cpu_topology();
+	topo.l3_domains.push_back({0, 0, -1, {}});
+	for(long i = 0; i < online; i++) {
+		topo.cores.push_back({{(unsigned)i}, 0});
+		topo.l3_domains[0].cores.push_back(i);
+	}
+	topo.pu_count = online;
+	topo.package_count = 1;
+	topo.numa_count = 1;
+
+	puL3.assign(online, 0);
+	puNuma.assign(online, -1);
+	puNodeset.assign(online, nullptr);
+}
+
+hwlocTopology::hwlocTopology() : topology(nullptr), loaded(false), bindThreadMemory(false) {
+	if(hwloc_topology_init(&topology) != 0) {
+		topology = nullptr;
+	} else if(hwloc_topology_load(topology) != 0) {
+		hwloc_topology_destroy(topology);
+		topology = nullptr;
+	}
+
+	if(topology == nullptr) {
+		std::cerr << __FILE__ << ":" << __LINE__ << "hwloc: can't load topology, assuming one core per CPU" << std::endl;
+		loadFlat();
+		return;
+	}
+
+	bindThreadMemory = hwloc_topology_get_support(topology)->membind->set_thisthread_membind;
+	topo.package_count = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_PACKAGE);
+	topo.numa_count = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_NUMANODE);
+
+	std::vector<hwloc_obj_t> l3Objs;
+	const int nCores = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_CORE);
+
+	for(int i = 0; i < nCores; i++) {
+		hwloc_obj_t coreObj = hwloc_get_obj_by_type(topology, HWLOC_OBJ_CORE, i);
+
+		cpu_topology::core core;
+		for(hwloc_obj_t pu = hwloc_get_next_obj_inside_cpuset_by_type(topology, coreObj->cpuset, HWLOC_OBJ_PU, nullptr);
+			pu != nullptr;
+			pu = hwloc_get_next_obj_inside_cpuset_by_type(topology, coreObj->cpuset, HWLOC_OBJ_PU, pu)) {
+			core.pus.push_back(pu->os_index);
+		}
+		if(core.pus.empty())
+			continue;
+
+		// Cores without an L3 above them (e.g. some VMs) share one pseudo domain
+		hwloc_obj_t l2Obj = nullptr;
+		hwloc_obj_t l3Obj = nullptr;
+		hwloc_obj_t packageObj = nullptr;
+		for(hwloc_obj_t obj = coreObj->parent; obj != nullptr; obj = obj->parent) {
+			if(l2Obj == nullptr && isL2Cache(obj))
+				l2Obj = obj;
+			if(l3Obj == nullptr && isL3Cache(obj))
+				l3Obj = obj;
+			if(packageObj == nullptr && obj->type == HWLOC_OBJ_PACKAGE)
+				packageObj = obj;
+		}
+
+		if(l2Obj != nullptr && topo.l2_size == 0)
+			topo.l2_size = l2Obj->attr->cache.size;
+
+		const int numaOsIndex = coreObj->nodeset != nullptr ? hwloc_bitmap_first(coreObj->nodeset) : -1;
+		hwloc_obj_t numaObj = numaOsIndex >= 0 ? hwloc_get_numanode_obj_by_os_index(topology, numaOsIndex) : nullptr;
+		const int numaNode = numaObj != nullptr ? (int)numaObj->logical_index : -1;
+
+		size_t domain = 0;
+		while(domain < l3Objs.size() && l3Objs[domain] != l3Obj)
+			domain++;
+		if(domain == l3Objs.size()) {
+			cpu_topology::l3_domain l3 = {0, 0, numaNode, {}};
+			if(l3Obj != nullptr)
+				l3.size = l3Obj->attr->cache.size;
+			if(packageObj != nullptr)
+				l3.package = packageObj->logical_index;
+
+			l3Objs.push_back(l3Obj);
+			topo.l3_domains.push_back(l3);
+		}
+
+		for(unsigned pu : core.pus) {
+			if(pu >= puL3.size()) {
+				puL3.resize(pu + 1, -1);
+				puNuma.resize(pu + 1, -1);
+				puNodeset.resize(pu + 1, nullptr);
+			}
+			puL3[pu] = domain;
+			puNuma[pu] = numaNode;
+			puNodeset[pu] = coreObj->nodeset;
+		}
+
+		core.l3 = domain;
+		topo.pu_count += core.pus.size();
+		topo.l3_domains[domain].cores.push_back(topo.cores.size());
+		topo.cores.push_back(core);
+	}
+
+	if(topo.cores.empty()) {
+		std::cerr << __FILE__ << ":" << __LINE__ << "hwloc: topology has no cores, assuming one core per CPU" << std::endl;
+		hwloc_topology_destroy(topology);
+		topology = nullptr;
+		bindThreadMemory = false;
+		loadFlat();
+		return;
+	}
+
+	if(topo.package_count == 0)
+		topo.package_count = 1;
+	if(topo.numa_count == 0)
+		topo.numa_count = 1;
+
+	loaded = true;
+}
+
+int hwlocTopology::numaNodeOfArea(const void* addr, size_t len) const {
+	int node = -1;
+#if HWLOC_API_VERSION >= 0x00010b03
+	if(topology == nullptr || addr == nullptr)
+		return -1;
+
+	hwloc_nodeset_t set = hwloc_bitmap_alloc();
+	if(hwloc_get_area_memlocation(topology, addr, len, set, HWLOC_MEMBIND_BYNODESET) == 0 && hwloc_bitmap_weight(set) == 1) {
+		hwloc_obj_t numaObj = hwloc_get_numanode_obj_by_os_index(topology, hwloc_bitmap_first(set));
+		if(numaObj != nullptr)
+			node = (int)numaObj->logical_index;
+	}
+	hwloc_bitmap_free(set);
+#endif
+	return node;
+}
+
+hwlocTopology::~hwlocTopology() {
+	// puNodeset points into the topology, it goes away with it
+	if(topology != nullptr)
+		hwloc_topology_destroy(topology);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <hwloc.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** CPU layout as seen by hwloc at runtime
+ *
+ * Only PUs the process is allowed to run on are listed, so cpusets and
+ * container limits are honoured.
+ */
+struct cpu_topology {
+	struct core {
+		std::vector<unsigned> pus;	// OS indexes, first PU first, then its SMT siblings
+		size_t l3;			// index into l3_domains
+	};
+
+	// One shared last level cache, i.e. a CCX on Zen or a whole package on most Intel parts
+	struct l3_domain {
+		uint64_t size;			// bytes, 0 if hwloc does not know
+		unsigned package;		// logical index of the package
+		int numa_node;			// logical index of the NUMA node, -1 if unknown
+		std::vector<size_t> cores;	// indexes into cores
+	};
+
+	std::vector<core> cores;
+	std::vector<l3_domain> l3_domains;
+	size_t pu_count = 0;
+	size_t package_count = 0;
+	size_t numa_count = 0;
+	uint64_t l2_size = 0;			// bytes per core
+};
+
+/** process wide hwloc topology
+ *
+ * Loaded once on first use and shared by the auto-configurator, thread
+ * startup and memory binding, so a big box walks sysfs once instead of once
+ * per mining thread. The PU lookups are plain array reads indexed by the
+ * PU's OS index.
+ */
+class hwlocTopology {
+public:
+	static hwlocTopology& inst();
+
+	const cpu_topology& cpu() const { return topo; }
+
+	/** false if hwloc could not be loaded, cpu() then holds a flat layout
+	 * with one core per online CPU and unknown cache sizes
+	 */
+	bool isLoaded() const { return loaded; }
+
+	/** logical index of the NUMA node of a PU, -1 if unknown */
+	int numaNodeOf(size_t puId) const {
+		return puId < puNuma.size() ? puNuma[puId] : -1;
+	}
+
+	/** logical index of the NUMA node the faulted in pages of [addr, addr + len)
+	 * are on, -1 if unknown, none are faulted in yet or they span several nodes
+	 */
+	int numaNodeOfArea(const void* addr, size_t len) const;
+
+	/** index into cpu().l3_domains of a PU, -1 if unknown */
+	int l3DomainOf(size_t puId) const {
+		return puId < puL3.size() ? puL3[puId] : -1;
+	}
+
+	/** NUMA nodes local to a PU, nullptr if unknown */
+	hwloc_const_nodeset_t nodesetOf(size_t puId) const {
+		return puId < puNodeset.size() ? puNodeset[puId] : nullptr;
+	}
+
+	/** NUMA node by logical index, nullptr if unknown */
+	hwloc_const_nodeset_t nodesetOfNode(int node) const {
+		if(topology == nullptr || node < 0)
+			return nullptr;
+		hwloc_obj_t obj = hwloc_get_obj_by_type(topology, HWLOC_OBJ_NUMANODE, node);
+		return obj != nullptr ? obj->nodeset : nullptr;
+	}
+
+	hwloc_topology_t handle() const { return topology; }
+
+	bool canBindThreadMemory() const { return bindThreadMemory; }
+
+private:
+	hwlocTopology();
+	~hwlocTopology();
+	hwlocTopology(const hwlocTopology&) = delete;
+	hwlocTopology& operator=(const hwlocTopology&) = delete;
+
+	void loadFlat();
+
+	hwloc_topology_t topology;
+	bool loaded;
+	bool bindThreadMemory;
+	cpu_topology topo;
+
+	std::vector<int> puNuma;
+	std::vector<int> puL3;
+	std::vector<hwloc_bitmap_t> puNodeset;
+};
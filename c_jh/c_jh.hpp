@@ -24,6 +24,14 @@ namespace c_jh {
 	} HashReturn;
 
 	HashReturn jh_hash(int hashbitlen, const BitSequence *data, DataLength databitlen, BitSequence *hashval);
+
+	/* JH-256 of byte aligned input with SSE2 (c_jh_sse2.cpp) */
+	void jh256_sse2(const BitSequence *data, size_t len, BitSequence *hashval);
+
+#ifdef __AVX2__
+	/* two messages of the same length, one per 128 bit lane, AVX2 builds only */
+	void jh256_avx2_x2(const BitSequence *const data[2], size_t len, BitSequence *const hashval[2]);
+#endif
 }
 
 #endif //MONERO_CPU_MINER_JH_JH_H
@@ -0,0 +1,215 @@
+/* JH-256 with SSE2, and AVX2 for two messages at once
+ *
+ * The bitslice implementation in c_jh.cpp keeps every row of the 1024 bit
+ * state as two 64 bit words, x[i][0] || x[i][1]. Here each row is one 128 bit
+ * register, so the Sbox and MDS layers work on both halves at once and the
+ * swapping layers become shifts and shuffles. None of them cross a 128 bit
+ * lane, so the same rounds on 256 bit registers hash two messages, one per
+ * lane. Uses the round constants and initial value of c_jh.cpp, byte aligned
+ * input only.
+ */
+
+#include "c_jh.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace c_jh {
+
+	/* the operations of the rounds, overloaded on the register width */
+	static inline __m128i jh_xor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+	static inline __m128i jh_and(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+	static inline __m128i jh_or(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+	static inline __m128i jh_andnot(__m128i a, __m128i b) { return _mm_andnot_si128(a, b); }
+	static inline __m128i jh_shl64(__m128i a, int n) { return _mm_slli_epi64(a, n); }
+	static inline __m128i jh_shr64(__m128i a, int n) { return _mm_srli_epi64(a, n); }
+	static inline __m128i jh_swap8(__m128i a) { return _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)); }
+	static inline __m128i jh_swap16(__m128i a) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xB1), 0xB1); }
+	static inline __m128i jh_swap32(__m128i a) { return _mm_shuffle_epi32(a, 0xB1); }
+	static inline __m128i jh_swap64(__m128i a) { return _mm_shuffle_epi32(a, 0x4E); }
+	static inline void jh_splat(__m128i &v, char c) { v = _mm_set1_epi8(c); }
+	static inline void jh_splat(__m128i &v, const unsigned char *p) { v = _mm_loadu_si128((const __m128i *) p); }
+
+#ifdef __AVX2__
+	static inline __m256i jh_xor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+	static inline __m256i jh_and(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+	static inline __m256i jh_or(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+	static inline __m256i jh_andnot(__m256i a, __m256i b) { return _mm256_andnot_si256(a, b); }
+	static inline __m256i jh_shl64(__m256i a, int n) { return _mm256_slli_epi64(a, n); }
+	static inline __m256i jh_shr64(__m256i a, int n) { return _mm256_srli_epi64(a, n); }
+	static inline __m256i jh_swap8(__m256i a) { return _mm256_or_si256(_mm256_slli_epi16(a, 8), _mm256_srli_epi16(a, 8)); }
+	static inline __m256i jh_swap16(__m256i a) { return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, 0xB1), 0xB1); }
+	static inline __m256i jh_swap32(__m256i a) { return _mm256_shuffle_epi32(a, 0xB1); }
+	static inline __m256i jh_swap64(__m256i a) { return _mm256_shuffle_epi32(a, 0x4E); }
+	static inline void jh_splat(__m256i &v, char c) { v = _mm256_set1_epi8(c); }
+	static inline void jh_splat(__m256i &v, const unsigned char *p) { v = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) p)); }
+#endif
+
+/* swap bit groups of width n inside every 2n bits, mask selects the low group */
+#define JH_SWAP_BITS(x, mask, n) jh_or(jh_shl64(jh_and((x), (mask)), (n)), jh_shr64(jh_andnot((mask), (x)), (n)))
+
+/* Sbox layer, the same boolean network as SS in c_jh.cpp */
+#define JH_SS(m0, m1, m2, m3, m4, m5, m6, m7, cc0, cc1)                 \
+	m3 = jh_xor(m3, ones);                                               \
+	m7 = jh_xor(m7, ones);                                               \
+	m0 = jh_xor(m0, jh_andnot(m2, cc0));                                 \
+	m4 = jh_xor(m4, jh_andnot(m6, cc1));                                 \
+	t0 = jh_xor(cc0, jh_and(m0, m1));                                    \
+	t1 = jh_xor(cc1, jh_and(m4, m5));                                    \
+	m0 = jh_xor(m0, jh_and(m2, m3));                                     \
+	m4 = jh_xor(m4, jh_and(m6, m7));                                     \
+	m3 = jh_xor(m3, jh_andnot(m1, m2));                                  \
+	m7 = jh_xor(m7, jh_andnot(m5, m6));                                  \
+	m1 = jh_xor(m1, jh_and(m0, m2));                                     \
+	m5 = jh_xor(m5, jh_and(m4, m6));                                     \
+	m2 = jh_xor(m2, jh_andnot(m3, m0));                                  \
+	m6 = jh_xor(m6, jh_andnot(m7, m4));                                  \
+	m0 = jh_xor(m0, jh_or(m1, m3));                                      \
+	m4 = jh_xor(m4, jh_or(m5, m7));                                      \
+	m3 = jh_xor(m3, jh_and(m1, m2));                                     \
+	m7 = jh_xor(m7, jh_and(m5, m6));                                     \
+	m1 = jh_xor(m1, jh_and(t0, m0));                                     \
+	m5 = jh_xor(m5, jh_and(t1, m4));                                     \
+	m2 = jh_xor(m2, t0);                                                 \
+	m6 = jh_xor(m6, t1);
+
+/* MDS layer */
+#define JH_L(m0, m1, m2, m3, m4, m5, m6, m7)                            \
+	m4 = jh_xor(m4, m1);                                                 \
+	m5 = jh_xor(m5, m2);                                                 \
+	m6 = jh_xor(m6, jh_xor(m0, m3));                                     \
+	m7 = jh_xor(m7, m0);                                                 \
+	m0 = jh_xor(m0, m5);                                                 \
+	m1 = jh_xor(m1, m6);                                                 \
+	m2 = jh_xor(m2, jh_xor(m4, m7));                                     \
+	m3 = jh_xor(m3, m4);
+
+#define JH_ROUND(r, SWAP)                                               \
+	jh_splat(cc0, E8_bitslice_roundconstant[r]);                         \
+	jh_splat(cc1, E8_bitslice_roundconstant[r] + 16);                    \
+	JH_SS(x[0], x[2], x[4], x[6], x[1], x[3], x[5], x[7], cc0, cc1);    \
+	JH_L(x[0], x[2], x[4], x[6], x[1], x[3], x[5], x[7]);               \
+	x[1] = SWAP(x[1]);                                                   \
+	x[3] = SWAP(x[3]);                                                   \
+	x[5] = SWAP(x[5]);                                                   \
+	x[7] = SWAP(x[7]);
+
+	/* the bijective function E8 */
+	template<typename V>
+	static inline void jh_e8(V x[8]) {
+		V ones, m1, m2, m4, cc0, cc1, t0, t1;
+		jh_splat(ones, (char) 0xff);
+		jh_splat(m1, (char) 0x55);
+		jh_splat(m2, (char) 0x33);
+		jh_splat(m4, (char) 0x0f);
+
+#define JH_SWAP1(x) JH_SWAP_BITS(x, m1, 1)
+#define JH_SWAP2(x) JH_SWAP_BITS(x, m2, 2)
+#define JH_SWAP4(x) JH_SWAP_BITS(x, m4, 4)
+
+		for (int r = 0; r < 42; r += 7) {
+			JH_ROUND(r + 0, JH_SWAP1);
+			JH_ROUND(r + 1, JH_SWAP2);
+			JH_ROUND(r + 2, JH_SWAP4);
+			JH_ROUND(r + 3, jh_swap8);
+			JH_ROUND(r + 4, jh_swap16);
+			JH_ROUND(r + 5, jh_swap32);
+			JH_ROUND(r + 6, jh_swap64);
+		}
+
+#undef JH_SWAP1
+#undef JH_SWAP2
+#undef JH_SWAP4
+	}
+
+	/* the compression function F8, m is the block in rows */
+	template<typename V>
+	static inline void jh_f8(V x[8], const V m[4]) {
+		for (int i = 0; i < 4; i++)
+			x[i] = jh_xor(x[i], m[i]);
+
+		jh_e8(x);
+
+		for (int i = 0; i < 4; i++)
+			x[i + 4] = jh_xor(x[i + 4], m[i]);
+	}
+
+	/* pad with a 1 bit and zeros to a whole block, then one more block ending in the
+	 * big endian bit length; a message of whole blocks gets both in one. Returns the
+	 * number of blocks written to buf. */
+	static inline size_t jh_pad(uint8_t buf[128], const BitSequence *data, size_t len) {
+		const size_t full = len / 64;
+		const size_t rem = len - full * 64;
+		const size_t pad_blocks = rem == 0 ? 1 : 2;
+		uint64_t bits = (uint64_t) len * 8;
+		memset(buf, 0, 128);
+		memcpy(buf, data + full * 64, rem);
+		buf[rem] = 0x80;
+		for (int i = 1; i <= 8; i++, bits >>= 8)
+			buf[pad_blocks * 64 - i] = (uint8_t) bits;
+		return pad_blocks;
+	}
+
+/* JH-256 of len bytes */
+	void jh256_sse2(const BitSequence *data, size_t len, BitSequence *hashval) {
+		uint8_t buf[128];
+		__m128i x[8], m[4];
+
+		for (int i = 0; i < 8; i++)
+			x[i] = _mm_loadu_si128((const __m128i *) JH256_H0 + i);
+
+		const size_t full = len / 64;
+		for (size_t b = 0; b < full; b++) {
+			for (int i = 0; i < 4; i++)
+				m[i] = _mm_loadu_si128((const __m128i *) (data + b * 64) + i);
+			jh_f8(x, m);
+		}
+
+		const size_t pad_blocks = jh_pad(buf, data, len);
+		for (size_t b = 0; b < pad_blocks; b++) {
+			for (int i = 0; i < 4; i++)
+				m[i] = _mm_loadu_si128((const __m128i *) (buf + b * 64) + i);
+			jh_f8(x, m);
+		}
+
+		/* the digest is the last 256 bits of the state */
+		_mm_storeu_si128((__m128i *) hashval, x[6]);
+		_mm_storeu_si128((__m128i *) (hashval + 16), x[7]);
+	}
+
+#ifdef __AVX2__
+/* JH-256 of two messages of len bytes, message j in lane j */
+	void jh256_avx2_x2(const BitSequence *const data[2], size_t len, BitSequence *const hashval[2]) {
+		uint8_t buf[2][128];
+		__m256i x[8], m[4];
+
+		for (int i = 0; i < 8; i++)
+			x[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) JH256_H0 + i));
+
+		const size_t full = len / 64;
+		for (size_t b = 0; b < full; b++) {
+			for (int i = 0; i < 4; i++)
+				m[i] = _mm256_loadu2_m128i((const __m128i *) (data[1] + b * 64) + i, (const __m128i *) (data[0] + b * 64) + i);
+			jh_f8(x, m);
+		}
+
+		jh_pad(buf[0], data[0], len);
+		const size_t pad_blocks = jh_pad(buf[1], data[1], len);
+		for (size_t b = 0; b < pad_blocks; b++) {
+			for (int i = 0; i < 4; i++)
+				m[i] = _mm256_loadu2_m128i((const __m128i *) (buf[1] + b * 64) + i, (const __m128i *) (buf[0] + b * 64) + i);
+			jh_f8(x, m);
+		}
+
+		_mm256_storeu2_m128i((__m128i *) hashval[1], (__m128i *) hashval[0], x[6]);
+		_mm256_storeu2_m128i((__m128i *) (hashval[1] + 16), (__m128i *) (hashval[0] + 16), x[7]);
+	}
+#endif
+
+#undef JH_SWAP_BITS
+#undef JH_SS
+#undef JH_L
+#undef JH_ROUND
+}
@@ -6,5 +6,18 @@
 #include "c_jh.hpp"
 
 void do_jh_hash(const uint8_t* input, std::size_t len, uint8_t* output) {
+	c_jh::jh256_sse2(input, len, output);
+}
+
+void do_jh_hash_ref(const uint8_t* input, std::size_t len, uint8_t* output) {
 	c_jh::jh_hash(32 * 8, input, 8 * len, output);
 }
+
+void do_jh_hash_multi(const uint8_t* const input[], std::size_t len, uint8_t* const output[], std::size_t n) {
+#ifdef __AVX2__
+	for (; n >= 2; n -= 2, input += 2, output += 2)
+		c_jh::jh256_avx2_x2(input, len, output);
+#endif
+	for (std::size_t i = 0; i < n; i++)
+		c_jh::jh256_sse2(input[i], len, output[i]);
+}
@@ -10,13 +10,18 @@
 namespace c_keccak {
 
 // compute a keccak hash (md) of given byte length from "in"
-	int keccak(const uint8_t *in, int inlen, uint8_t *md, int mdlen);
+	void keccak(const uint8_t *in, int inlen, uint8_t *md, int mdlen);
 
 // update the state
 	void keccakf(uint64_t st[25], int norounds);
 
 	void keccak1600(const uint8_t *in, int inlen, uint8_t *md);
 
+// multi-buffer versions, 4 states per pass with AVX2 and 8 with AVX-512 (c_keccak_multi.cpp)
+	void keccakf_multi(uint64_t *st[], size_t n, int norounds);
+
+	void keccak1600_multi(const uint8_t *in, int inlen, uint64_t *st[], size_t n);
+
 }
 
 #endif //MONERO_CPU_MINER_C_KECCAK_H
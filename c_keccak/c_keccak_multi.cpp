@@ -0,0 +1,184 @@
+// c_keccak_multi.cpp
+// Multi-buffer Keccak-f[1600]: lane j of every vector register holds word i of state j, so
+// one pass of the permutation advances 4 states with AVX2 or 8 with AVX-512. Built as part of
+// the hash kernels after c_keccak.cpp, whose round constants and scalar keccakf it shares.
+
+#include <stdint.h>
+#include <memory.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace c_keccak {
+
+#if defined(__AVX512F__)
+	typedef __m512i keccak_vec;
+	static const size_t keccak_lanes = 8;
+
+	static inline keccak_vec kv_load(const uint64_t *w) { return _mm512_loadu_si512(w); }
+	static inline void kv_store(uint64_t *w, keccak_vec v) { _mm512_storeu_si512(w, v); }
+	static inline keccak_vec kv_set1(uint64_t x) { return _mm512_set1_epi64(x); }
+	static inline keccak_vec kv_xor(keccak_vec a, keccak_vec b) { return _mm512_xor_si512(a, b); }
+	static inline keccak_vec kv_xor5(keccak_vec a, keccak_vec b, keccak_vec c, keccak_vec d, keccak_vec e) {
+		// 0x96 is a ^ b ^ c
+		return _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(a, b, c, 0x96), d, e, 0x96);
+	}
+	// a ^ (~b & c)
+	static inline keccak_vec kv_chi(keccak_vec a, keccak_vec b, keccak_vec c) { return _mm512_ternarylogic_epi64(a, b, c, 0xD2); }
+#define KV_ROTL(x, y) _mm512_rol_epi64((x), (y))
+#elif defined(__AVX2__)
+	typedef __m256i keccak_vec;
+	static const size_t keccak_lanes = 4;
+
+	static inline keccak_vec kv_load(const uint64_t *w) { return _mm256_loadu_si256((const __m256i *) w); }
+	static inline void kv_store(uint64_t *w, keccak_vec v) { _mm256_storeu_si256((__m256i *) w, v); }
+	static inline keccak_vec kv_set1(uint64_t x) { return _mm256_set1_epi64x(x); }
+	static inline keccak_vec kv_xor(keccak_vec a, keccak_vec b) { return _mm256_xor_si256(a, b); }
+	static inline keccak_vec kv_xor5(keccak_vec a, keccak_vec b, keccak_vec c, keccak_vec d, keccak_vec e) {
+		return _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(c, d)), e);
+	}
+	static inline keccak_vec kv_chi(keccak_vec a, keccak_vec b, keccak_vec c) { return _mm256_xor_si256(a, _mm256_andnot_si256(b, c)); }
+#define KV_ROTL(x, y) _mm256_or_si256(_mm256_slli_epi64((x), (y)), _mm256_srli_epi64((x), 64 - (y)))
+#else
+	static const size_t keccak_lanes = 1;
+#endif
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+	// keccak_lanes states at once, unused lanes may point at any scratch state
+	static void keccakf_lanes(uint64_t *st[keccak_lanes], int rounds) {
+		alignas(64) uint64_t t[keccak_lanes];
+		keccak_vec s[25], bc[5], d;
+		int i, round;
+
+		for (i = 0; i < 25; i++) {
+			for (size_t j = 0; j < keccak_lanes; j++)
+				t[j] = st[j][i];
+			s[i] = kv_load(t);
+		}
+
+		for (round = 0; round < rounds; ++round) {
+
+			// Theta
+			for (i = 0; i < 5; ++i)
+				bc[i] = kv_xor5(s[i], s[i + 5], s[i + 10], s[i + 15], s[i + 20]);
+
+			for (i = 0; i < 5; ++i) {
+				d = kv_xor(bc[(i + 4) % 5], KV_ROTL(bc[(i + 1) % 5], 1));
+				s[i] = kv_xor(s[i], d);
+				s[i + 5] = kv_xor(s[i + 5], d);
+				s[i + 10] = kv_xor(s[i + 10], d);
+				s[i + 15] = kv_xor(s[i + 15], d);
+				s[i + 20] = kv_xor(s[i + 20], d);
+			}
+
+			// Rho Pi, the same lane walk as the scalar keccakf
+			d = s[1];
+			s[1] = KV_ROTL(s[6], 44);
+			s[6] = KV_ROTL(s[9], 20);
+			s[9] = KV_ROTL(s[22], 61);
+			s[22] = KV_ROTL(s[14], 39);
+			s[14] = KV_ROTL(s[20], 18);
+			s[20] = KV_ROTL(s[2], 62);
+			s[2] = KV_ROTL(s[12], 43);
+			s[12] = KV_ROTL(s[13], 25);
+			s[13] = KV_ROTL(s[19], 8);
+			s[19] = KV_ROTL(s[23], 56);
+			s[23] = KV_ROTL(s[15], 41);
+			s[15] = KV_ROTL(s[4], 27);
+			s[4] = KV_ROTL(s[24], 14);
+			s[24] = KV_ROTL(s[21], 2);
+			s[21] = KV_ROTL(s[8], 55);
+			s[8] = KV_ROTL(s[16], 45);
+			s[16] = KV_ROTL(s[5], 36);
+			s[5] = KV_ROTL(s[3], 28);
+			s[3] = KV_ROTL(s[18], 21);
+			s[18] = KV_ROTL(s[17], 15);
+			s[17] = KV_ROTL(s[11], 10);
+			s[11] = KV_ROTL(s[7], 6);
+			s[7] = KV_ROTL(s[10], 3);
+			s[10] = KV_ROTL(d, 1);
+
+			//  Chi
+			for (i = 0; i < 25; i += 5) {
+				bc[0] = s[i];
+				bc[1] = s[i + 1];
+				bc[2] = s[i + 2];
+				bc[3] = s[i + 3];
+				bc[4] = s[i + 4];
+
+				s[i] = kv_chi(bc[0], bc[1], bc[2]);
+				s[i + 1] = kv_chi(bc[1], bc[2], bc[3]);
+				s[i + 2] = kv_chi(bc[2], bc[3], bc[4]);
+				s[i + 3] = kv_chi(bc[3], bc[4], bc[0]);
+				s[i + 4] = kv_chi(bc[4], bc[0], bc[1]);
+			}
+
+			//  Iota
+			s[0] = kv_xor(s[0], kv_set1(keccakf_rndc[round]));
+		}
+
+		for (i = 0; i < 25; i++) {
+			kv_store(t, s[i]);
+			for (size_t j = 0; j < keccak_lanes; j++)
+				st[j][i] = t[j];
+		}
+	}
+#undef KV_ROTL
+#endif
+
+// update n states with given number of rounds
+
+	void keccakf_multi(uint64_t *st[], size_t n, int rounds) {
+#if defined(__AVX512F__) || defined(__AVX2__)
+		uint64_t scratch[25] = { 0 };
+		uint64_t *lanes[keccak_lanes];
+
+		// One or two left over states are as fast on the scalar code as in a mostly empty register
+		while (n >= 3) {
+			const size_t used = n < keccak_lanes ? n : keccak_lanes;
+			for (size_t j = 0; j < keccak_lanes; j++)
+				lanes[j] = j < used ? st[j] : scratch;
+			keccakf_lanes(lanes, rounds);
+			st += used;
+			n -= used;
+		}
+#endif
+		for (size_t j = 0; j < n; j++)
+			keccakf(st[j], rounds);
+	}
+
+// keccak1600 of n inputs of inlen bytes each, in[j] = in + j * inlen, into n 200 byte states
+
+	void keccak1600_multi(const uint8_t *in, int inlen, uint64_t *st[], size_t n) {
+		const int rsizw = HASH_DATA_AREA / 8;
+		uint8_t temp[HASH_DATA_AREA];
+		size_t j;
+		int i, done;
+
+		for (j = 0; j < n; j++)
+			memset(st[j], 0, 200);
+
+		for (done = 0; inlen - done >= HASH_DATA_AREA; done += HASH_DATA_AREA) {
+			for (j = 0; j < n; j++) {
+				memcpy(temp, in + j * inlen + done, HASH_DATA_AREA);
+				for (i = 0; i < rsizw; i++)
+					st[j][i] ^= ((uint64_t *) temp)[i];
+			}
+			keccakf_multi(st, n, KECCAK_ROUNDS);
+		}
+
+		// last block and padding
+		for (j = 0; j < n; j++) {
+			memcpy(temp, in + j * inlen + done, inlen - done);
+			temp[inlen - done] = 1;
+			memset(temp + inlen - done + 1, 0, HASH_DATA_AREA - (inlen - done) - 1);
+			temp[HASH_DATA_AREA - 1] |= 0x80;
+
+			for (i = 0; i < rsizw; i++)
+				st[j][i] ^= ((uint64_t *) temp)[i];
+		}
+
+		keccakf_multi(st, n, KECCAK_ROUNDS);
+	}
+}
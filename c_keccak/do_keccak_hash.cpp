@@ -7,10 +7,19 @@
 
 // compute a keccak hash (md) of given byte length from "in"
 int do_keccak(const uint8_t *in, int inlen, uint8_t *md, int mdlen) {
-	return c_keccak::keccak(in, inlen, md, mdlen);
+	c_keccak::keccak(in, inlen, md, mdlen);
+	return 0;
 }
 
 // update the state
 void do_keccakf(uint64_t st[25], int norounds) {
 	c_keccak::keccakf(st, norounds);
 }
+
+void do_keccak_multi(const uint8_t *in, int inlen, uint64_t *st[], size_t n) {
+	c_keccak::keccak1600_multi(in, inlen, st, n);
+}
+
+void do_keccakf_multi(uint64_t *st[], size_t n, int norounds) {
+	c_keccak::keccakf_multi(st, n, norounds);
+}
@@ -5,6 +5,7 @@
 #ifndef C_KECCAK_DO_KECCAK_H
 #define C_KECCAK_DO_KECCAK_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // compute a keccak hash (md) of given byte length from "in"
@@ -13,4 +14,10 @@ int do_keccak(const uint8_t *in, int inlen, uint8_t *md, int mdlen);
 // update the state
 void do_keccakf(uint64_t st[25], int norounds);
 
+// keccak1600 of n inputs of inlen bytes each, laid out back to back, into n 200 byte states
+void do_keccak_multi(const uint8_t *in, int inlen, uint64_t *st[], size_t n);
+
+// update n states at once
+void do_keccakf_multi(uint64_t *st[], size_t n, int norounds);
+
 #endif //C_KECCAK_DO_KECCAK_H
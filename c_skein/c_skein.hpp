@@ -47,5 +47,8 @@ namespace c_skein {
 /* "all-in-one" call */
 	HashReturn skein_hash(int hashbitlen, const SkeinBitSequence *data, SkeinDataLength databitlen, SkeinBitSequence *hashval);
 
+/* Skein-512-256 of n messages of len bytes, four at a time with AVX2 (c_skein_multi.cpp) */
+	void skein512_256_multi(const u08b_t *const data[], size_t len, u08b_t *const hashval[], size_t n);
+
 }
 #endif  /* ifndef _SKEIN_H_ */
@@ -0,0 +1,173 @@
+/***********************************************************************
+**
+** Multi-buffer Skein-512-256 with AVX2
+**
+** Lane j of every 256 bit register holds word i of message j, so one pass
+** of Threefish-512 runs the scalar MIX network of Skein_512_Process_Block
+** for four messages of the same length. Unlike a single message spread over
+** the lanes, the word permutation between rounds is only a renaming of
+** registers. Built as part of the hash kernels after c_skein.cpp, whose IV,
+** rotation counts and tweak flags it shares.
+**
+************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace c_skein {
+
+#ifdef __AVX2__
+
+#if defined(__AVX512VL__)
+#define SKEIN4_ROTL(x, n) _mm256_rol_epi64((x), (n))
+#else
+#define SKEIN4_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi64((x), (n)), _mm256_srli_epi64((x), 64 - (n)))
+#endif
+
+#define SKEIN4_MIX(p0, p1, rot)                                          \
+	X[p0] = _mm256_add_epi64(X[p0], X[p1]);                               \
+	X[p1] = _mm256_xor_si256(SKEIN4_ROTL(X[p1], rot), X[p0]);
+
+#define SKEIN4_ROUND(p0, p1, p2, p3, p4, p5, p6, p7, ROT)                \
+	SKEIN4_MIX(p0, p1, ROT##_0)                                           \
+	SKEIN4_MIX(p2, p3, ROT##_1)                                           \
+	SKEIN4_MIX(p4, p5, ROT##_2)                                           \
+	SKEIN4_MIX(p6, p7, ROT##_3)
+
+/* key injection s, the s-th subkey in the words of X */
+#define SKEIN4_INJECT(s)                                                                         \
+	for (int i = 0; i < 8; i++)                                                                   \
+		X[i] = _mm256_add_epi64(X[i], key[((s) + i) % 9]);                                        \
+	X[5] = _mm256_add_epi64(X[5], _mm256_set1_epi64x(twk[(s) % 3]));                              \
+	X[6] = _mm256_add_epi64(X[6], _mm256_set1_epi64x(twk[((s) + 1) % 3]));                        \
+	X[7] = _mm256_add_epi64(X[7], _mm256_set1_epi64x(s));
+
+	/* 4x4 transpose of 64 bit words, r[j] word i becomes r[i] word j */
+	static inline void skein_transpose4(__m256i &r0, __m256i &r1, __m256i &r2, __m256i &r3) {
+		const __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+		const __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+		const __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+		const __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+		r0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+		r1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+		r2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+		r3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+	}
+
+	/* one UBI block of each message, H <- E(H, T, w) ^ w, all with the same tweak */
+	static inline void skein512_block_x4(__m256i H[8], const u08b_t *const block[4], u64b_t t0, u64b_t t1) {
+		const u64b_t twk[3] = {t0, t1, t0 ^ t1};
+		__m256i w[8], key[9], X[8];
+		int i;
+
+		for (i = 0; i < 4; i++) {
+			w[i] = _mm256_loadu_si256((const __m256i *) block[i]);
+			w[i + 4] = _mm256_loadu_si256((const __m256i *) (block[i] + 32));
+		}
+		skein_transpose4(w[0], w[1], w[2], w[3]);
+		skein_transpose4(w[4], w[5], w[6], w[7]);
+
+		/* words 0-3 of every block are now in w[0..3] and 4-7 in w[4..7] */
+		key[8] = _mm256_set1_epi64x(SKEIN_KS_PARITY);
+		for (i = 0; i < 8; i++) {
+			key[i] = H[i];
+			key[8] = _mm256_xor_si256(key[8], H[i]);
+			X[i] = w[i];
+		}
+
+		SKEIN4_INJECT(0);
+		for (int s = 1; s < SKEIN_512_ROUNDS_TOTAL / 4; s += 2) {
+			SKEIN4_ROUND(0, 1, 2, 3, 4, 5, 6, 7, R_512_0);
+			SKEIN4_ROUND(2, 1, 4, 7, 6, 5, 0, 3, R_512_1);
+			SKEIN4_ROUND(4, 1, 6, 3, 0, 5, 2, 7, R_512_2);
+			SKEIN4_ROUND(6, 1, 0, 7, 2, 5, 4, 3, R_512_3);
+			SKEIN4_INJECT(s);
+			SKEIN4_ROUND(0, 1, 2, 3, 4, 5, 6, 7, R_512_4);
+			SKEIN4_ROUND(2, 1, 4, 7, 6, 5, 0, 3, R_512_5);
+			SKEIN4_ROUND(4, 1, 6, 3, 0, 5, 2, 7, R_512_6);
+			SKEIN4_ROUND(6, 1, 0, 7, 2, 5, 4, 3, R_512_7);
+			SKEIN4_INJECT(s + 1);
+		}
+
+		for (i = 0; i < 8; i++)
+			H[i] = _mm256_xor_si256(X[i], w[i]);
+	}
+
+#undef SKEIN4_ROTL
+#undef SKEIN4_MIX
+#undef SKEIN4_ROUND
+#undef SKEIN4_INJECT
+
+	/* four messages of len bytes */
+	static void skein512_256_x4(const u08b_t *const data[4], size_t len, u08b_t *const hashval[4]) {
+		u08b_t buf[4][SKEIN_512_BLOCK_BYTES];
+		const u08b_t *block[4];
+		__m256i H[8];
+		u64b_t t0 = 0;
+		u64b_t t1 = SKEIN_T1_FLAG_FIRST | SKEIN_T1_BLK_TYPE_MSG;
+		size_t done = 0;
+		int i, j;
+
+		for (i = 0; i < 8; i++)
+			H[i] = _mm256_set1_epi64x(SKEIN_512_IV_256[i]);
+
+		/* every block but the last, which may be full, goes through without the final flag */
+		for (; len - done > SKEIN_512_BLOCK_BYTES; done += SKEIN_512_BLOCK_BYTES) {
+			t0 += SKEIN_512_BLOCK_BYTES;
+			for (j = 0; j < 4; j++)
+				block[j] = data[j] + done;
+			skein512_block_x4(H, block, t0, t1);
+			t1 &= ~SKEIN_T1_FLAG_FIRST;
+		}
+
+		for (j = 0; j < 4; j++) {
+			memset(buf[j], 0, sizeof(buf[j]));
+			memcpy(buf[j], data[j] + done, len - done);
+			block[j] = buf[j];
+		}
+		skein512_block_x4(H, block, t0 + len - done, t1 | SKEIN_T1_FLAG_FINAL);
+
+		/* output stage, one block of counter 0 */
+		for (j = 0; j < 4; j++)
+			memset(buf[j], 0, sizeof(buf[j]));
+		skein512_block_x4(H, block, sizeof(u64b_t), SKEIN_T1_FLAG_FIRST | SKEIN_T1_BLK_TYPE_OUT_FINAL);
+
+		skein_transpose4(H[0], H[1], H[2], H[3]);
+		for (j = 0; j < 4; j++)
+			_mm256_storeu_si256((__m256i *) hashval[j], H[j]);
+	}
+
+#endif
+
+/* Skein-512-256 of n messages of len bytes */
+	void skein512_256_multi(const u08b_t *const data[], size_t len, u08b_t *const hashval[], size_t n) {
+#ifdef __AVX2__
+		u08b_t scratch[32];
+		const u08b_t *lane_data[4];
+		u08b_t *lane_hash[4];
+
+		/* the scalar code runs its four MIX at once, one or two messages are faster there
+		 * unless the rotates are single AVX-512VL instructions */
+#if defined(__AVX512VL__)
+		const size_t min_lanes = 2;
+#else
+		const size_t min_lanes = 3;
+#endif
+		while (n >= min_lanes) {
+			const size_t used = n < 4 ? n : 4;
+			for (size_t j = 0; j < 4; j++) {
+				lane_data[j] = data[j < used ? j : 0];
+				lane_hash[j] = j < used ? hashval[j] : scratch;
+			}
+			skein512_256_x4(lane_data, len, lane_hash);
+			data += used;
+			hashval += used;
+			n -= used;
+		}
+#endif
+		for (size_t j = 0; j < n; j++)
+			skein_hash(8 * 32, data[j], 8 * len, hashval[j]);
+	}
+}
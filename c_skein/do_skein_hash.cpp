@@ -8,3 +8,7 @@
 void do_skein_hash(const uint8_t* input, std::size_t len, uint8_t* output) {
 	c_skein::skein_hash(8 * 32, input, 8 * len, output);
 }
+
+void do_skein_hash_multi(const uint8_t* const input[], std::size_t len, uint8_t* const output[], std::size_t n) {
+	c_skein::skein512_256_multi(input, len, output, n);
+}
@@ -10,4 +10,7 @@
 
 void do_skein_hash(const uint8_t* input, std::size_t len, uint8_t* output);
 
+// n inputs of len bytes into n 32 byte outputs, several at once where the kernel has SIMD for it
+void do_skein_hash_multi(const uint8_t* const input[], std::size_t len, uint8_t* const output[], std::size_t n);
+
 #endif //MONERO_CPU_MINER_DO_SKEIN_H
@@ -1,10 +1,14 @@
 #include "autoAdjust.hpp"
 
 #include "c_cryptonight/cryptonight.hpp"
+#include "c_hwlock/hwlocTopology.hpp"
+#include "xmrstak/system_constants.hpp"
 #include <string.h>
 #include <cpuid.h>
+#include <algorithm>
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 
 
 // Mask bits between h and l and return the value
@@ -21,112 +25,212 @@ void cpuid(uint32_t eax, int32_t ecx, int32_t val[4])
 	__cpuid_count(eax, ecx, val[0], val[1], val[2], val[3]);
 }
 
-void check_cpu_features(bool & haveAes, bool & haveSse2)
+// XCR0, the register state the OS saves on a context switch
+static uint64_t xgetbv0()
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+xmrstak::cpu::cpu_features xmrstak::cpu::get_cpu_features()
 {
 	constexpr int AESNI_BIT = 1 << 25;
+	constexpr int OSXSAVE_BIT = 1 << 27;
+	constexpr int AVX_BIT = 1 << 28;
 	constexpr int SSE2_BIT = 1 << 26;
+	constexpr int AVX2_BIT = 1 << 5;
+	constexpr int BMI2_BIT = 1 << 8;
+	constexpr int AVX512F_BIT = 1 << 16;
+	constexpr int AVX512BW_BIT = 1 << 30;
+	constexpr int AVX512VL_BIT = (int)(1u << 31);
+	constexpr int VAES_BIT = 1 << 9;
+	constexpr uint64_t XCR0_YMM = 0x6; // XMM | YMM
+	constexpr uint64_t XCR0_ZMM = 0xe6; // XMM | YMM | opmask | ZMM_Hi256 | Hi16_ZMM
 	int32_t cpu_info[4];
-	bool bHaveSse2;
+	cpu_features features = {};
+
+	cpuid(0, 0, cpu_info);
+	const int32_t max_leaf = cpu_info[0];
 
 	cpuid(1, 0, cpu_info);
+	features.aes = (cpu_info[2] & AESNI_BIT) != 0;
+	features.sse2 = (cpu_info[3] & SSE2_BIT) != 0;
+
+	const uint64_t xcr0 = (cpu_info[2] & OSXSAVE_BIT) != 0 ? xgetbv0() : 0;
+	const bool os_ymm = (xcr0 & XCR0_YMM) == XCR0_YMM;
+	const bool os_zmm = (xcr0 & XCR0_ZMM) == XCR0_ZMM;
+	features.avx = os_ymm && (cpu_info[2] & AVX_BIT) != 0;
+
+	if(max_leaf >= 7) {
+		cpuid(7, 0, cpu_info);
+		features.avx2 = features.avx && (cpu_info[1] & AVX2_BIT) != 0;
+		features.bmi2 = (cpu_info[1] & BMI2_BIT) != 0;
+		features.avx512 = os_zmm && (cpu_info[1] & AVX512F_BIT) != 0 && (cpu_info[1] & AVX512BW_BIT) != 0 && (cpu_info[1] & AVX512VL_BIT) != 0;
+		features.vaes = features.avx && (cpu_info[2] & VAES_BIT) != 0;
+	}
+
+	return features;
+}
+
+std::string xmrstak::cpu::get_cpu_model()
+{
+	int32_t cpu_info[4];
+	char brand[49] = {0};
+
+	cpuid(0x80000000, 0, cpu_info);
+	if((uint32_t)cpu_info[0] < 0x80000004)
+		return "unknown";
 
-	haveAes = (cpu_info[2] & AESNI_BIT) != 0;
-	haveSse2 = (cpu_info[3] & SSE2_BIT) != 0;
+	for(uint32_t i = 0; i < 3; i++) {
+		cpuid(0x80000002 + i, 0, cpu_info);
+		memcpy(brand + 16 * i, cpu_info, 16);
+	}
+
+	// Trim the padding some vendors put around the name
+	std::string model(brand);
+	model.erase(0, model.find_first_not_of(' '));
+	model.erase(model.find_last_not_of(' ') + 1);
+	return model;
+}
+
+bool xmrstak::cpu::cn_kernels_supported(const cpu_features& features, cn_isa_level level)
+{
+	switch(level) {
+	case cn_isa_sse2:
+		return features.sse2;
+	case cn_isa_avx:
+		return features.sse2 && features.avx;
+	case cn_isa_avx2:
+		return features.sse2 && features.avx2 && features.bmi2;
+	case cn_isa_vaes:
+		return features.sse2 && features.avx2 && features.bmi2 && features.vaes;
+	case cn_isa_avx512:
+		return features.sse2 && features.avx2 && features.bmi2 && features.avx512 && features.vaes;
+	default:
+		return false;
+	}
+}
+
+bool xmrstak::cpu::cn_use_soft_aes()
+{
+	static const bool soft_aes = !::system_constants::HaveHardwareAes() || !get_cpu_features().aes;
+	return soft_aes;
+}
+
+const cn_kernels& xmrstak::cpu::select_cn_kernels()
+{
+	static const cn_kernels& kernels = [] () -> const cn_kernels& {
+		const cpu_features features = get_cpu_features();
+
+		std::cout << __FILE__ << ":" << __LINE__ << ":" << " cpu features: sse2=" << features.sse2 << " aes=" << features.aes
+			<< " avx=" << features.avx << " avx2=" << features.avx2 << " bmi2=" << features.bmi2
+			<< " avx512=" << features.avx512 << " vaes=" << features.vaes << std::endl;
+
+		if(!features.sse2) {
+			throw new std::runtime_error("CPU support of SSE2 is required.");
+		}
+
+		int level = cn_isa_count - 1;
+		while(level > cn_isa_sse2 && !cn_kernels_supported(features, (cn_isa_level)level))
+			level--;
+
+		const cn_kernels& k = cn_get_kernels((cn_isa_level)level);
+		std::cout << __FILE__ << ":" << __LINE__ << ":" << " using " << k.name << " hash kernels with "
+			<< (cn_use_soft_aes() ? "software" : "hardware") << " AES" << std::endl;
+		return k;
+	}();
+	return kernels;
 }
 
 void parse_config() {
-	bool haveAes = false;
-	bool haveSse2 = false;
-	check_cpu_features(haveAes, haveSse2);
+	const xmrstak::cpu::cpu_features features = xmrstak::cpu::get_cpu_features();
 
-	if(!haveSse2) {
+	if(!features.sse2) {
 		throw new std::runtime_error("CPU support of SSE2 is required.");
 	}
-	if(!haveAes) {
-		throw new std::runtime_error("WARNING: CPU support of AES is not available.");
+	if(!features.aes) {
+		std::cerr << __FILE__ << ":" << __LINE__ << ":" << " WARNING: CPU support of AES is not available, falling back to software AES." << std::endl;
 	}
 }
 
 
 xmrstak::cpu::auto_threads::auto_threads() :
 		hashMemSize(MONERO_MEMORY),
-		halfHashMemSize(MONERO_MEMORY / 2u),
-		processors_count(CONFIG_SYSTEM_NPROC),
-		cache_l2(CONFIG_SYSTEM_CACHE_L2),
-		cache_l3(CONFIG_SYSTEM_CACHE_L3),
-		configs(CONFIG_SYSTEM_NPROC) {
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: hashMemSize      = " << hashMemSize << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: halfHashMemSize  = " << halfHashMemSize << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: processors_count = " << processors_count << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: cache_l2         = " << cache_l2 << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: cache_l3         = " << cache_l3 << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: configs.size     = " << configs.size() << std::endl;
+		halfHashMemSize(MONERO_MEMORY / 2u) {
 
 	parse_config();
 
-	int32_t cpu_info[4];
-	const int32_t L3KB_size = cache_l3;
-	bool old_amd = false;
-	char cpustr[13] = {0};
+	const cpu_topology& topo = hwlocTopology::inst().cpu();
 
-	cpuid(0, 0, cpu_info);
-	memcpy(cpustr, &cpu_info[1], 4);
-	memcpy(cpustr + 4, &cpu_info[3], 4);
-	memcpy(cpustr + 8, &cpu_info[2], 4);
-
-	if (strcmp(cpustr, "GenuineIntel") == 0) {
-		//		L3KB_size = calc_genuine_intel(cpu_info);
-	} else if (strcmp(cpustr, "AuthenticAMD") == 0) {
-		//		L3KB_size = calc_authentic_amd(cpu_info);
-		old_amd = is_old_amd(cpu_info);
-	} else {
-		std::cerr << __FILE__ << ":" << __LINE__ << ":" << "Autoconf failed: Unknown CPU type: " << cpustr << std::endl;
-		throw new std::runtime_error("Failed to detect CPU type");
-	}
+	processors_count = topo.pu_count;
+	cores_count = topo.cores.size();
+	l3_domains_count = topo.l3_domains.size();
+	cache_l2 = topo.l2_size;
+	cache_l3 = 0;
+	for (const auto& l3 : topo.l3_domains)
+		cache_l3 += l3.size;
 
-	const bool isLessThanMem = L3KB_size < halfHashMemSize;
-	const bool isMoreThan100u = L3KB_size > (halfHashMemSize * 100u);
-	if (isLessThanMem) {
-		std::cerr << __FILE__ << ":" << __LINE__ << ":" << " Autoconf failed: L3 size sanity check failed " << L3KB_size << " KB" << " vs halfHashMemSize=" << halfHashMemSize << std::endl;
-		// throw new std::runtime_error("L3 size sanity check failed");
-	} else if (isMoreThan100u) {
-		std::cerr << __FILE__ << ":" << __LINE__ << ":" << " Autoconf failed: L3 size sanity check failed " << L3KB_size << " KB" << " vs halfHashMemSize * 100u = " << halfHashMemSize * 100u << std::endl;
-		// throw new std::runtime_error("L3 size sanity check failed");
+	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: hashMemSize      = " << hashMemSize << std::endl;
+	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: processors_count = " << processors_count << std::endl;
+	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: cores_count      = " << cores_count << std::endl;
+	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: packages         = " << topo.package_count << std::endl;
+	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: numa_nodes       = " << topo.numa_count << std::endl;
+	std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: cache_l2         = " << cache_l2 << std::endl;
+	for (size_t d = 0; d < topo.l3_domains.size(); d++) {
+		const auto& l3 = topo.l3_domains[d];
+		std::cout << __FILE__ << ":" << __LINE__ << ":" << " auto_threads: l3 domain " << d << "      = " << l3.size << " bytes, "
+			<< l3.cores.size() << " cores, package " << l3.package << ", numa node " << l3.numa_node << std::endl;
 	}
 
-
-	uint32_t affine_to_cpu = 0;
-	const int32_t requred_cache_per_thread = 1024 * 1024 * 2;
-	const int32_t available_cache_per_thread = cache_l3 / (requred_cache_per_thread * processors_count);
-	const int32_t low_power_mode = available_cache_per_thread > 5 ? 5 : available_cache_per_thread;
-
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " Autoconf processors_count           = " << processors_count << " on Linux" << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " Autoconf requred_cache_per_thread   = " << requred_cache_per_thread << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " Autoconf available_cache_per_thread = " << available_cache_per_thread << std::endl;
-	std::cout << __FILE__ << ":" << __LINE__ << ":" << " Autoconf low_power_mode             = " << low_power_mode << " on Linux" << std::endl;
-
-	for (uint32_t i = 0; i < processors_count; i++) {
-		auto_thd_cfg config = auto_thd_cfg();
-		config.low_power_mode = low_power_mode;
-		config.affine_to_cpu = affine_to_cpu;
-		configs[i] = config;
-
-		if (old_amd) {
-			affine_to_cpu += 2;
-			if (affine_to_cpu >= processors_count)
-				affine_to_cpu = 1;
-		} else {
-			affine_to_cpu++;
+	// Placement order: the first PU of every core, then the second PU of every core and so on.
+	// Within each round the L3 domains take turns, so any prefix of the list loads all L3
+	// domains evenly and SMT siblings only come in after every core has a thread.
+	size_t max_cores_per_l3 = 0;
+	size_t max_smt = 0;
+	for (const auto& l3 : topo.l3_domains)
+		max_cores_per_l3 = std::max(max_cores_per_l3, l3.cores.size());
+	for (const auto& core : topo.cores)
+		max_smt = std::max(max_smt, core.pus.size());
+
+	std::vector<size_t> l3_of_placement;
+	for (size_t smt = 0; smt < max_smt; smt++) {
+		for (size_t k = 0; k < max_cores_per_l3; k++) {
+			for (size_t d = 0; d < topo.l3_domains.size(); d++) {
+				const auto& l3 = topo.l3_domains[d];
+				if (k >= l3.cores.size() || smt >= topo.cores[l3.cores[k]].pus.size())
+					continue;
+
+				auto_thd_cfg config = auto_thd_cfg();
+				config.affine_to_cpu = topo.cores[l3.cores[k]].pus[smt];
+				config.low_power_mode = 1;
+				placement.push_back(config);
+				l3_of_placement.push_back(d);
+			}
 		}
 	}
-}
 
+	// Two scratchpad heavy threads on SMT siblings usually just fight over L1/L2, so by
+	// default every core gets one thread. The auto-tuner measures the SMT variant.
+	configs.assign(placement.begin(), placement.begin() + cores_count);
 
-bool xmrstak::cpu::auto_threads::is_old_amd(int32_t *cpu_info) {
-	cpuid(0x80000006, 0, cpu_info);
-	cpuid(1, 0, cpu_info);
-	if (get_masked(cpu_info[0], 11, 8) < 0x17) //0x17h is Zen
-		return true;
-	return false;
-}
+	// Without tuning, share each L3 domain between the threads placed in it
+	const uint64_t requred_cache_per_thread = MONERO_MEMORY;
+	for (size_t d = 0; d < topo.l3_domains.size(); d++) {
+		size_t threads_in_l3 = 0;
+		for (size_t i = 0; i < configs.size(); i++)
+			threads_in_l3 += l3_of_placement[i] == d;
+		if (threads_in_l3 == 0)
+			continue;
 
+		const uint64_t available_cache_per_thread = topo.l3_domains[d].size / (requred_cache_per_thread * threads_in_l3);
+		const int low_power_mode = (int)std::max<uint64_t>(1, std::min<uint64_t>(5, available_cache_per_thread));
+
+		std::cout << __FILE__ << ":" << __LINE__ << ":" << " Autoconf l3 domain " << d << ": " << threads_in_l3 << " threads, low_power_mode = " << low_power_mode << std::endl;
+
+		for (size_t i = 0; i < configs.size(); i++) {
+			if (l3_of_placement[i] == d)
+				configs[i].low_power_mode = low_power_mode;
+		}
+	}
+}
@@ -3,14 +3,42 @@
 #include <unistd.h>
 #include <vector>
 #include <cstdint>
+#include <string>
+
+#include "c_cryptonight/cryptonight_kernels.hpp"
 
 namespace xmrstak
 {
 	namespace cpu {
 
+		struct cpu_features {
+			bool sse2;
+			bool aes;
+			bool avx;
+			bool avx2;
+			bool bmi2;
+			bool avx512;	// F + VL + BW with ZMM state enabled by the OS
+			bool vaes;
+		};
+
+		// cpuid probe, including the XGETBV check that the OS saves the wide registers
+		cpu_features get_cpu_features();
+
+		// cpuid brand string, e.g. "AMD Ryzen 7 1700 Eight-Core Processor"
+		std::string get_cpu_model();
+
+		bool cn_kernels_supported(const cpu_features& features, cn_isa_level level);
+
+		// Best kernel table for this CPU, picked on the first call. Uses software AES if the
+		// CPU lacks AES-NI or CONFIG_AES_OVERRIDE is false, see cn_use_soft_aes().
+		const cn_kernels& select_cn_kernels();
+		bool cn_use_soft_aes();
+
 		struct auto_thd_cfg {
 			int low_power_mode;
 			long long affine_to_cpu;
+			bool prefetch;	// pipelined main loop, hash[..][1] of the kernel table
+			bool asm_loop;	// hand scheduled main loop, hash_asm of the kernel table
 		};
 
 		class auto_threads {
@@ -18,15 +46,18 @@ namespace xmrstak
 
 			const size_t hashMemSize;
 			const size_t halfHashMemSize;
-			const uint32_t processors_count;
-			const uint32_t cache_l2;
-			const uint32_t cache_l3;
+			uint32_t processors_count;
+			uint32_t cores_count;
+			uint32_t l3_domains_count;
+			uint64_t cache_l2;
+			uint64_t cache_l3;	// sum over all L3 domains
+
+			// One entry per usable PU in the order threads should be added, see auto_threads()
+			std::vector<auto_thd_cfg> placement;
+			// The threads to start, a prefix of placement
 			std::vector<auto_thd_cfg> configs;
 
 			auto_threads();
-
-		private:
-			bool is_old_amd(int32_t *cpu_info);
 		};
 
 	}
@@ -0,0 +1,272 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  */
+
+#include "autoTune.hpp"
+#include "console.hpp"
+#include "minethd.hpp"
+#include "c_cryptonight/cryptonight_kernels.hpp"
+#include "c_cryptonight/cryptonight_pool.hpp"
+#include "c_hwlock/hwlocTopology.hpp"
+#include "c_hwlock/do_hwlock.hpp"
+#include "includes/json.hpp"
+#include "xmrstak/system_constants.hpp"
+#include "xmrstak/net/time_utils.hpp"
+
+#include <pthread.h>
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace xmrstak
+{
+namespace cpu
+{
+
+std::string tuning_key(const auto_threads& threads)
+{
+	return get_cpu_model() + " / " + std::to_string(threads.processors_count) + " cpus";
+}
+
+static nlohmann::json read_tuning_cache(const std::string& file)
+{
+	std::ifstream in(file);
+	if(!in)
+		return nlohmann::json::object();
+
+	try
+	{
+		nlohmann::json cache = nlohmann::json::parse(in);
+		if(cache.is_object())
+			return cache;
+	}
+	catch(const std::exception& e)
+	{
+		printer::print_msg(L1, "WARNING ignoring unreadable tuning cache %s: %s", file.c_str(), e.what());
+	}
+	return nlohmann::json::object();
+}
+
+bool load_tuning(const std::string& file, const std::string& key, tuning_result& result)
+{
+	const nlohmann::json cache = read_tuning_cache(file);
+	auto entry = cache.find(key);
+	if(entry == cache.end() || !entry->is_object())
+		return false;
+
+	try
+	{
+		result.multiway = entry->at("multiway").get<int>();
+		result.threads = entry->at("threads").get<uint32_t>();
+		result.hashrate = entry->value("hashrate", 0.0);
+		result.prefetch = entry->value("prefetch", false);
+		result.asm_loop = entry->value("asm", false);
+	}
+	catch(const std::exception&)
+	{
+		return false;
+	}
+
+	return result.multiway >= 1 && result.multiway <= CN_MAX_MULTIWAY && result.threads >= 1 &&
+		(!result.asm_loop || result.multiway <= CN_ASM_MULTIWAY);
+}
+
+bool save_tuning(const std::string& file, const std::string& key, const tuning_result& result)
+{
+	// Other CPU models sharing the file (e.g. on NFS) keep their entries
+	nlohmann::json cache = read_tuning_cache(file);
+	nlohmann::json& entry = cache[key];
+	entry["multiway"] = result.multiway;
+	entry["threads"] = result.threads;
+	entry["hashrate"] = result.hashrate;
+	entry["prefetch"] = result.prefetch;
+	entry["asm"] = result.asm_loop;
+	entry["kernels"] = select_cn_kernels().name;
+
+	std::ofstream out(file, std::ios::trunc);
+	if(!out)
+		return false;
+	out << cache.dump(4) << std::endl;
+	return out.good();
+}
+
+double run_tuning_trial(const auto_threads& threads, uint32_t nThreads, int N, bool bPrefetch, bool bAsm, uint64_t iTrialMs)
+{
+	const cn_kernels& kernels = select_cn_kernels();
+	const cn_hash_fun_multi hash_fun = bAsm ? kernels.hash_asm[N - 1] : kernels.hash[cn_use_soft_aes()][bPrefetch][N - 1];
+	std::vector<double> vRates(nThreads, 0.0);
+	std::vector<std::thread> vThreads;
+	std::atomic<uint32_t> iReady(0);
+
+	for(uint32_t t = 0; t < nThreads; t++)
+	{
+		vThreads.emplace_back([&, t]() {
+			const long long affinity = threads.placement[t].affine_to_cpu;
+			const int node = affinity >= 0 ? hwlocTopology::inst().numaNodeOf(affinity) : -1;
+			if(affinity >= 0)
+			{
+				minethd::thd_setaffinity(pthread_self(), affinity);
+				do_hwlock(affinity);
+			}
+
+			cryptonight_ctx* ctx[CN_MAX_MULTIWAY];
+			uint8_t bWorkBlob[76 * CN_MAX_MULTIWAY] = { 0 };
+			uint8_t bHashOut[32 * CN_MAX_MULTIWAY];
+			bool bAllocOk = true;
+
+			for(int i = 0; i < N; i++)
+			{
+				ctx[i] = cryptonight_pool::inst().acquire(node, minethd::minethd_alloc_ctx);
+				bAllocOk &= ctx[i] != nullptr;
+			}
+
+			// First hash pays for the page faults, keep it out of the measurement
+			if(bAllocOk)
+				hash_fun(bWorkBlob, 76, bHashOut, ctx);
+
+			// Start timing only once every thread is warm, so all of them compete for L3
+			iReady++;
+			while(iReady.load() < nThreads)
+				std::this_thread::yield();
+
+			uint64_t iCount = 0;
+			uint64_t iStart = get_timestamp_ms();
+			uint64_t iNow = iStart;
+			uint32_t* piNonce = (uint32_t*)(bWorkBlob + 39);
+
+			while(bAllocOk && iNow - iStart < iTrialMs)
+			{
+				(*piNonce)++;
+				hash_fun(bWorkBlob, 76, bHashOut, ctx);
+				iCount += N;
+				iNow = get_timestamp_ms();
+			}
+
+			if(iNow > iStart)
+				vRates[t] = iCount * 1000.0 / (iNow - iStart);
+
+			for(int i = 0; i < N; i++)
+			{
+				cryptonight_pool::inst().release(ctx[i]);
+			}
+		});
+	}
+
+	double fTotal = 0.0;
+	for(uint32_t t = 0; t < nThreads; t++)
+	{
+		vThreads[t].join();
+		fTotal += vRates[t];
+	}
+	return fTotal;
+}
+
+void auto_tune(auto_threads& threads)
+{
+	if(!::system_constants::GetAutotune() || threads.placement.empty())
+		return;
+
+	const std::string file = ::system_constants::get_autotune_cache_file();
+	const std::string key = tuning_key(threads);
+	tuning_result best = { 0, 0, false, false, 0.0 };
+
+	if(load_tuning(file, key, best) && best.threads <= threads.placement.size())
+	{
+		printer::print_msg(L0, "Autotune: using cached %dx, %u threads%s (%.1f H/s) for %s.", best.multiway, best.threads,
+			best.asm_loop ? ", asm" : best.prefetch ? ", prefetch" : "", best.hashrate, key.c_str());
+	}
+	else
+	{
+		const uint64_t iTrialMs = ::system_constants::GetAutotuneTrialTime();
+
+		// Placement prefixes: one thread per core, then every PU if the cores have SMT siblings.
+		// Both spread evenly over the L3 domains.
+		std::vector<uint32_t> vThreadCounts = { threads.cores_count };
+		if(threads.placement.size() > threads.cores_count)
+			vThreadCounts.push_back(threads.placement.size());
+
+		printer::print_msg(L0, "Autotune: no cached result for %s, running trials of %llu ms.", key.c_str(), (unsigned long long)iTrialMs);
+
+		best = { 0, 0, false, false, 0.0 };
+		for(uint32_t nThreads : vThreadCounts)
+		{
+			double fBestForCount = 0.0;
+			for(int N = 1; N <= CN_MAX_MULTIWAY; N++)
+			{
+				const double fRate = run_tuning_trial(threads, nThreads, N, false, false, iTrialMs);
+				printer::print_msg(L0, "Autotune: %dx, %u threads: %.1f H/s", N, nThreads, fRate);
+
+				if(fRate > best.hashrate)
+					best = { N, nThreads, false, false, fRate };
+
+				// Once the scratchpads spill out of L3 every wider setting is slower still
+				if(fRate < fBestForCount * 0.9)
+					break;
+				if(fRate > fBestForCount)
+					fBestForCount = fRate;
+			}
+		}
+
+		if(best.threads == 0)
+		{
+			printer::print_msg(L0, "Autotune: all trials failed, keeping the L3 based configuration.");
+			return;
+		}
+
+		// Whether prefetching the next line pays depends on how much of the miss latency the
+		// other lanes already hide, so it is only measured for the winning configuration
+		const double fPrefetchRate = run_tuning_trial(threads, best.threads, best.multiway, true, false, iTrialMs);
+		printer::print_msg(L0, "Autotune: %dx, %u threads, prefetch: %.1f H/s", best.multiway, best.threads, fPrefetchRate);
+		if(fPrefetchRate > best.hashrate)
+		{
+			best.prefetch = true;
+			best.hashrate = fPrefetchRate;
+		}
+
+		// The hand scheduled loops are tuned for no particular core, so they have to beat the
+		// compiler's schedule on this one
+		if(best.multiway <= CN_ASM_MULTIWAY && !cn_use_soft_aes())
+		{
+			const double fAsmRate = run_tuning_trial(threads, best.threads, best.multiway, false, true, iTrialMs);
+			printer::print_msg(L0, "Autotune: %dx, %u threads, asm: %.1f H/s", best.multiway, best.threads, fAsmRate);
+			if(fAsmRate > best.hashrate)
+			{
+				best.prefetch = false;
+				best.asm_loop = true;
+				best.hashrate = fAsmRate;
+			}
+		}
+
+		if(save_tuning(file, key, best))
+			printer::print_msg(L0, "Autotune: picked %dx, %u threads%s (%.1f H/s), saved to %s.", best.multiway, best.threads,
+				best.asm_loop ? ", asm" : best.prefetch ? ", prefetch" : "", best.hashrate, file.c_str());
+		else
+			printer::print_msg(L0, "Autotune: picked %dx, %u threads%s (%.1f H/s), WARNING could not write %s.", best.multiway, best.threads,
+				best.asm_loop ? ", asm" : best.prefetch ? ", prefetch" : "", best.hashrate, file.c_str());
+	}
+
+	threads.configs.assign(threads.placement.begin(), threads.placement.begin() + best.threads);
+	for(auto& config : threads.configs)
+	{
+		config.low_power_mode = best.multiway;
+		config.prefetch = best.prefetch;
+		config.asm_loop = best.asm_loop;
+	}
+}
+
+} // namespace cpu
+} // namepsace xmrstak
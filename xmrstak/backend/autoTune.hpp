@@ -0,0 +1,41 @@
+#pragma once
+
+#include "autoAdjust.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace xmrstak
+{
+namespace cpu
+{
+
+struct tuning_result
+{
+	int multiway;		// hashes per thread and kernel call
+	uint32_t threads;	// mining threads, a prefix of auto_threads::placement
+	bool prefetch;		// pipelined main loop
+	bool asm_loop;		// hand scheduled main loop, only for multiway <= CN_ASM_MULTIWAY
+	double hashrate;	// aggregate H/s measured for this configuration
+};
+
+// Replaces the L3 formula in auto_threads with a measured configuration. The first start on a
+// CPU model runs short timed trials of every multiway width with one thread per core and with
+// one thread per PU, then the winner once more with the prefetching main loop and, if there is
+// one for its width, the asm main loop. The result is written to the tuning cache per CPU
+// model, so later starts skip the trials.
+// Does nothing if CONFIG_AUTOTUNE is false.
+void auto_tune(auto_threads& threads);
+
+// Key of this machine in the tuning cache
+std::string tuning_key(const auto_threads& threads);
+
+bool load_tuning(const std::string& file, const std::string& key, tuning_result& result);
+bool save_tuning(const std::string& file, const std::string& key, const tuning_result& result);
+
+// Aggregate H/s of nThreads threads, pinned to the first nThreads placement entries, each
+// hashing N-way for iTrialMs milliseconds
+double run_tuning_trial(const auto_threads& threads, uint32_t nThreads, int N, bool bPrefetch, bool bAsm, uint64_t iTrialMs);
+
+} // namespace cpu
+} // namepsace xmrstak
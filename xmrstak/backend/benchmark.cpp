@@ -0,0 +1,276 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "benchmark.hpp"
+#include "xmrstak/backend/autoAdjust.hpp"
+#include "xmrstak/backend/globalStates.hpp"
+#include "xmrstak/backend/minethd.hpp"
+#include "console.hpp"
+#include "xmrstak/net/msgstruct.hpp"
+#include "xmrstak/net/time_utils.hpp"
+#include "includes/json.hpp"
+
+#include <dirent.h>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace xmrstak
+{
+
+namespace
+{
+
+// One share per this many hashes on average, often enough for the share path to be timed
+// with the rest, rarely enough not to fill the (never drained) result queue.
+constexpr uint64_t iBenchmarkDiff = 1000;
+
+// A Monero block header is 76 bytes, the nonce sits at byte 39
+constexpr uint32_t iBenchmarkBlobLen = 76;
+
+struct rapl_zone
+{
+	std::string sPath;
+	std::string sName;
+	uint64_t iMaxRange;
+	uint64_t iStart;
+};
+
+bool read_u64(const std::string& sFile, uint64_t& iVal)
+{
+	std::ifstream in(sFile);
+	return static_cast<bool>(in >> iVal);
+}
+
+// The package zones intel-rapl:N only, their core / uncore / dram subzones intel-rapl:N:M
+// are already counted in the package. energy_uj is usually readable by root only.
+std::vector<rapl_zone> open_rapl_zones()
+{
+	const std::string sBase = "/sys/class/powercap/";
+	std::vector<rapl_zone> vZones;
+
+	DIR* dir = opendir(sBase.c_str());
+	if(dir == nullptr)
+		return vZones;
+
+	while(dirent* ent = readdir(dir))
+	{
+		const std::string sName(ent->d_name);
+		if(sName.compare(0, 11, "intel-rapl:") != 0 || sName.find(':', 11) != std::string::npos)
+			continue;
+
+		rapl_zone zone;
+		zone.sPath = sBase + sName + "/";
+		if(!read_u64(zone.sPath + "energy_uj", zone.iStart))
+			continue;
+		if(!read_u64(zone.sPath + "max_energy_range_uj", zone.iMaxRange))
+			zone.iMaxRange = 0;
+
+		std::ifstream in(zone.sPath + "name");
+		if(!std::getline(in, zone.sName))
+			zone.sName = sName;
+		vZones.push_back(zone);
+	}
+	closedir(dir);
+	return vZones;
+}
+
+// Joules used since open_rapl_zones, the counters wrap at max_energy_range_uj
+double read_rapl_joules(const std::vector<rapl_zone>& vZones)
+{
+	double fJoules = 0.0;
+	for(const rapl_zone& zone : vZones)
+	{
+		uint64_t iNow;
+		if(!read_u64(zone.sPath + "energy_uj", iNow))
+			continue;
+		const uint64_t iDelta = iNow >= zone.iStart ? iNow - zone.iStart : zone.iMaxRange - zone.iStart + iNow;
+		fJoules += iDelta / 1e6;
+	}
+	return fJoules;
+}
+
+void mean_stddev(const std::vector<double>& vRates, double& fMean, double& fStddev)
+{
+	fMean = 0.0;
+	fStddev = 0.0;
+	if(vRates.empty())
+		return;
+
+	for(double r : vRates)
+		fMean += r;
+	fMean /= vRates.size();
+
+	for(double r : vRates)
+		fStddev += (r - fMean) * (r - fMean);
+	fStddev = std::sqrt(fStddev / vRates.size());
+}
+
+} // namespace
+
+int run_benchmark(uint64_t iSeconds, const std::string& sJsonFile)
+{
+	if(!cpu::minethd::self_test())
+		return 1;
+
+	if(iSeconds == 0)
+		iSeconds = 1;
+
+	globalStates::inst().iGlobalJobNo = 0;
+	msgstruct::miner_work oStall;
+	std::vector<iBackend*> vThreads = cpu::minethd::thread_starter(0, oStall);
+	if(vThreads.empty())
+	{
+		printer::print_msg(L0, "ERROR: No CPU threads configured, nothing to benchmark.");
+		return 1;
+	}
+
+	msgstruct_v2::job_id_str_t job_id;
+	job_id.fill(0);
+	memcpy(job_id.data(), "benchmark", 9);
+
+	msgstruct_v2::work_blob_byte_t blob;
+	blob.fill(0);
+	for(uint32_t i = 0; i < iBenchmarkBlobLen; i++)
+		blob[i] = static_cast<uint8_t>(i * 7 + 1);
+
+	msgstruct::miner_work oWork(job_id, blob, iBenchmarkBlobLen, UINT64_MAX / iBenchmarkDiff);
+	pool_data dat;
+	globalStates::inst().switch_work(oWork, dat);
+
+	// Don't time the first batch of each thread, it pays for the page faults of its scratchpads
+	printer::print_msg(L0, "Benchmark: %u threads, warming up.", (unsigned)vThreads.size());
+	const uint64_t iWarmupEnd = get_timestamp_ms() + 60 * 1000;
+	for(iBackend* thd : vThreads)
+	{
+		while(thd->oStats.snapshot().iHashCount == 0 && get_timestamp_ms() < iWarmupEnd)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	const size_t iThd = vThreads.size();
+	std::vector<thd_stats_snapshot> vStart(iThd), vLast(iThd);
+	std::vector<std::vector<double>> vRates(iThd);
+	const std::vector<rapl_zone> vZones = open_rapl_zones();
+
+	const uint64_t iStart = get_timestamp_us();
+	uint64_t iLast = iStart;
+	for(size_t i = 0; i < iThd; i++)
+		vStart[i] = vLast[i] = vThreads[i]->oStats.snapshot();
+
+	printer::print_msg(L0, "Benchmark: running for %llu s.", (unsigned long long)iSeconds);
+	for(uint64_t s = 0; s < iSeconds; s++)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		const uint64_t iNow = get_timestamp_us();
+		for(size_t i = 0; i < iThd; i++)
+		{
+			const thd_stats_snapshot oSnap = vThreads[i]->oStats.snapshot();
+			vRates[i].push_back((oSnap.iHashCount - vLast[i].iHashCount) * 1e6 / (iNow - iLast));
+			vLast[i] = oSnap;
+		}
+		iLast = iNow;
+	}
+
+	const double fSeconds = (iLast - iStart) / 1e6;
+	const double fJoules = vZones.empty() ? 0.0 : read_rapl_joules(vZones);
+	const cn_kernels& kernels = cpu::select_cn_kernels();
+
+	nlohmann::json summary;
+	summary["seconds"] = fSeconds;
+	summary["kernels"] = kernels.name;
+	summary["soft_aes"] = cpu::cn_use_soft_aes();
+	summary["difficulty"] = iBenchmarkDiff;
+	summary["threads"] = nlohmann::json::array();
+
+	uint64_t iTotalHashes = 0, iTotalShares = 0;
+	for(size_t i = 0; i < iThd; i++)
+	{
+		const cpu::minethd* thd = static_cast<const cpu::minethd*>(vThreads[i]);
+		const uint64_t iHashes = vLast[i].iHashCount - vStart[i].iHashCount;
+		const uint64_t iShares = vLast[i].iSharesFound - vStart[i].iSharesFound;
+		double fMean, fStddev;
+		mean_stddev(vRates[i], fMean, fStddev);
+
+		// A thread only reports whole batches, so short runs of wide multiway threads look
+		// noisier per second than they are. The mean over the run is exact.
+		const double fRate = iHashes / fSeconds;
+		printer::print_msg(L0, "Thread %u: %dx %s, affinity %lld: %.1f H/s, stddev %.1f H/s (%.1f%%), %llu shares.",
+			(unsigned)i, thd->get_multiway(), thd->get_main_loop(), (long long)thd->get_affinity(),
+			fRate, fStddev, fMean > 0.0 ? fStddev * 100.0 / fMean : 0.0, (unsigned long long)iShares);
+
+		nlohmann::json entry;
+		entry["thread"] = i;
+		entry["multiway"] = thd->get_multiway();
+		entry["main_loop"] = thd->get_main_loop();
+		entry["affinity"] = thd->get_affinity();
+		entry["hashes"] = iHashes;
+		entry["hashrate"] = fRate;
+		entry["hashrate_stddev"] = fStddev;
+		entry["shares"] = iShares;
+		summary["threads"].push_back(entry);
+
+		iTotalHashes += iHashes;
+		iTotalShares += iShares;
+	}
+
+	const double fTotalRate = iTotalHashes / fSeconds;
+	printer::print_msg(L0, "Total: %.1f H/s, %llu hashes, %llu shares in %.1f s.",
+		fTotalRate, (unsigned long long)iTotalHashes, (unsigned long long)iTotalShares, fSeconds);
+	summary["hashes"] = iTotalHashes;
+	summary["hashrate"] = fTotalRate;
+	summary["shares"] = iTotalShares;
+
+	if(!vZones.empty() && fJoules > 0.0)
+	{
+		printer::print_msg(L0, "Energy: %.1f J, %.1f W, %.2f H/J (RAPL, %u package zones).",
+			fJoules, fJoules / fSeconds, iTotalHashes / fJoules, (unsigned)vZones.size());
+		summary["energy_joules"] = fJoules;
+		summary["watts"] = fJoules / fSeconds;
+		summary["hashes_per_joule"] = iTotalHashes / fJoules;
+	}
+	else
+	{
+		printer::print_msg(L0, "Energy: RAPL counters not readable, no H/J.");
+		summary["energy_joules"] = nullptr;
+		summary["watts"] = nullptr;
+		summary["hashes_per_joule"] = nullptr;
+	}
+
+	if(!sJsonFile.empty())
+	{
+		std::ofstream out(sJsonFile);
+		out << summary.dump(4) << std::endl;
+		if(!out)
+		{
+			printer::print_msg(L0, "ERROR: could not write %s.", sJsonFile.c_str());
+			return 1;
+		}
+		printer::print_msg(L0, "Benchmark summary written to %s.", sJsonFile.c_str());
+	}
+	return 0;
+}
+
+} // namespace xmrstak
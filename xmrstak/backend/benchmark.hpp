@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace xmrstak
+{
+
+// Mines a synthetic job for iSeconds without a pool: the threads come from
+// minethd::thread_starter exactly as for mining, the job has an easy target so the share
+// path runs too, and the results are never sent anywhere. Prints per thread and total H/s,
+// the spread of the per second rates of every thread, hashes per joule if RAPL energy
+// counters are readable. With sJsonFile set, also writes a JSON summary there, stdout carries
+// the log. Returns the process exit code.
+int run_benchmark(uint64_t iSeconds, const std::string& sJsonFile);
+
+} // namespace xmrstak
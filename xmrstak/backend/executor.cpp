@@ -46,7 +46,6 @@
 std::vector<xmrstak::iBackend*>* thread_starter(msgstruct::miner_work& pWork)
 {
 	xmrstak::globalStates::inst().iGlobalJobNo = 0;
-	xmrstak::globalStates::inst().iConsumeCnt = 0;
 	std::vector<xmrstak::iBackend*>* pvThreads = new std::vector<xmrstak::iBackend*>;
 
 	auto cpuThreads = xmrstak::cpu::minethd::thread_starter(static_cast<uint32_t>(pvThreads->size()), pWork);
@@ -55,7 +54,6 @@ std::vector<xmrstak::iBackend*>* thread_starter(msgstruct::miner_work& pWork)
 		throw new std::runtime_error("Error: Backend CPU disabled.");
 	}
 
-	xmrstak::globalStates::inst().iThreadCount = pvThreads->size();
 	return pvThreads;
 }
 
@@ -364,6 +362,7 @@ void executor::ex_main()
 	}
 
 	telem = new xmrstak::telemetry(pvThreads->size());
+	vLastStats.resize(pvThreads->size());
 
 	set_timestamp();
 	pool_ptr = std::shared_ptr<jpsock>(new jpsock());
@@ -415,12 +414,7 @@ void executor::ex_main()
 
 		case msgstruct::EV_PERF_TICK:
 			statsd::statsd_increment("ev.perf_tick");
-			for (int i = 0; i < pvThreads->size(); i++) {
-				uint64_t iHashCount = pvThreads->at(i)->iHashCount.load(std::memory_order_relaxed);
-				uint64_t iTimestamp = pvThreads->at(i)->iTimestamp.load(std::memory_order_relaxed);
-				telem->push_perf_value(i, iHashCount, iTimestamp);
-				statsd::statsd_gauge("i_hash_count", iHashCount);
-			}
+			on_perf_tick();
 
 			if((cnt++ & 0xF) == 0) //Every 16 ticks
 			{
@@ -448,6 +442,14 @@ void executor::ex_main()
 
 				statsd::statsd_gauge("f_hps", fHps);
 				statsd::statsd_gauge("max_f_hps", fHighestHps);
+
+				const xmrstak::latency_histogram& oLat = xmrstak::globalStates::inst().oSwitchLatency;
+				if(oLat.count() != 0)
+				{
+					statsd::statsd_gauge("job_switch_latency_p50_us", oLat.percentile(50.0));
+					statsd::statsd_gauge("job_switch_latency_p99_us", oLat.percentile(99.0));
+					statsd::statsd_gauge("job_switch_latency_max_us", oLat.percentile(100.0));
+				}
 			}
 			break;
 
@@ -464,6 +466,56 @@ void executor::ex_main()
 	}
 }
 
+void executor::on_perf_tick()
+{
+	// Mining threads only publish counters, the timestamp is taken here on the reader side
+	const uint64_t iTimestamp = get_timestamp_ms();
+	xmrstak::thd_stats_snapshot oDelta;
+
+	for (size_t i = 0; i < pvThreads->size(); i++) {
+		const xmrstak::thd_stats_snapshot oSnap = pvThreads->at(i)->oStats.snapshot();
+		xmrstak::thd_stats_snapshot& oLast = vLastStats[i];
+
+		telem->push_perf_value(i, oSnap.iHashCount, iTimestamp);
+		statsd::statsd_gauge("i_hash_count", oSnap.iHashCount);
+
+		oDelta.iSharesFound += oSnap.iSharesFound - oLast.iSharesFound;
+		oDelta.iHashAbandoned += oSnap.iHashAbandoned - oLast.iHashAbandoned;
+		oDelta.iJobSwitches += oSnap.iJobSwitches - oLast.iJobSwitches;
+		oDelta.iStallMs += oSnap.iStallMs - oLast.iStallMs;
+		for (size_t f = 0; f < 4; f++)
+		{
+			oDelta.iFinalHashes[f] += oSnap.iFinalHashes[f] - oLast.iFinalHashes[f];
+			oDelta.iFinalCycles[f] += oSnap.iFinalCycles[f] - oLast.iFinalCycles[f];
+		}
+		oLast = oSnap;
+	}
+
+	if (oDelta.iSharesFound != 0)
+		statsd::statsd_count("ev.share_found", (int)oDelta.iSharesFound);
+	if (oDelta.iHashAbandoned != 0)
+		statsd::statsd_count("ev.hash_abandoned", (int)oDelta.iHashAbandoned);
+	if (oDelta.iJobSwitches != 0)
+		statsd::statsd_count("ev.job_switch", (int)oDelta.iJobSwitches);
+	if (oDelta.iStallMs != 0)
+		statsd::statsd_count("thread_stall_ms", (int)oDelta.iStallMs);
+
+	// How the finalizers split between the four hashes and what each costs per hash state
+	static const char* const finalizer_keys[4][2] = {
+		{ "finalizer.blake.hashes", "finalizer.blake.cycles_per_hash" },
+		{ "finalizer.groestl.hashes", "finalizer.groestl.cycles_per_hash" },
+		{ "finalizer.jh.hashes", "finalizer.jh.cycles_per_hash" },
+		{ "finalizer.skein.hashes", "finalizer.skein.cycles_per_hash" }
+	};
+	for (size_t f = 0; f < 4; f++)
+	{
+		if (oDelta.iFinalHashes[f] == 0)
+			continue;
+		statsd::statsd_count(finalizer_keys[f][0], (int)oDelta.iFinalHashes[f]);
+		statsd::statsd_gauge(finalizer_keys[f][1], (unsigned int)(oDelta.iFinalCycles[f] / oDelta.iFinalHashes[f]));
+	}
+}
+
 inline const char* hps_format(double h, char* buf, size_t l)
 {
 	if(std::isnormal(h) || h == 0.0)
@@ -654,6 +706,16 @@ std::string executor::connection_report()
 	else
 		out.append("Pool ping time  : (n/a)\n");
 
+	const xmrstak::latency_histogram& oLat = xmrstak::globalStates::inst().oSwitchLatency;
+	if(oLat.count() != 0)
+	{
+		snprintf(num, sizeof(num), "Job switch time : p50 <= %llu us, p99 <= %llu us, max <= %llu us\n",
+			int_port(oLat.percentile(50.0)), int_port(oLat.percentile(99.0)), int_port(oLat.percentile(100.0)));
+		out.append(num);
+	}
+	else
+		out.append("Job switch time : (n/a)\n");
+
 	out.append("\nNetwork error log:\n");
 	size_t ln = vSocketLog.size();
 	if(ln > 0)
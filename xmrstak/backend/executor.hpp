@@ -121,6 +121,7 @@ private:
 
 	xmrstak::telemetry* telem;
 	std::vector<xmrstak::iBackend*>* pvThreads;
+	std::vector<xmrstak::thd_stats_snapshot> vLastStats;
 
 	size_t dev_timestamp;
 
@@ -135,6 +136,7 @@ private:
 	std::string result_report();
 	std::string connection_report();
 	void print_report();
+	void on_perf_tick();
 
 	std::vector<sck_error_log> vSocketLog;
 	std::vector<result_tally> vMineResults;
@@ -23,6 +23,7 @@
 
 #include "globalStates.hpp"
 #include "xmrstak/net/msgstruct.hpp"
+#include "xmrstak/net/time_utils.hpp"
 
 #include <cmath>
 #include <chrono>
@@ -34,17 +35,71 @@ namespace xmrstak
 
 void globalStates::switch_work(msgstruct::miner_work& pWork, pool_data& dat)
 {
-	// iConsumeCnt is a basic lock-like polling mechanism just in case we happen to push work
-	// faster than threads can consume them. This should never happen in real life.
-	// Pool cant physically send jobs faster than every 250ms or so due to net latency.
+	// Publishing is wait-free: we write the slot the threads are not using, then bump
+	// iGlobalJobNo. A slow or descheduled thread can't hold up the others or us, it just
+	// picks up the newest job whenever it gets around to it.
+	const uint64_t iJobNo = iGlobalJobNo.load(std::memory_order_relaxed) + 1;
+	work_slot& slot = aWorkSlot[iJobNo & 1];
 
-	while (iConsumeCnt.load(std::memory_order_seq_cst) < iThreadCount)
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	const uint64_t iSeq = slot.iSeq.load(std::memory_order_relaxed);
+	slot.iSeq.store(iSeq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
 
 	dat.iSavedNonce = iGlobalNonce.exchange(dat.iSavedNonce, std::memory_order_seq_cst);
-	oGlobalWork = pWork;
-	iConsumeCnt.store(0, std::memory_order_seq_cst);
-	iGlobalJobNo++;
+	slot.oWork = pWork;
+	slot.iPublishStamp = get_timestamp_us();
+
+	slot.iSeq.store(iSeq + 2, std::memory_order_release);
+	iGlobalJobNo.store(iJobNo, std::memory_order_seq_cst);
+
+	// Pairs with the increment in wait_for_work, either we see the waiter or it sees the new job
+	if(iWaiters.load(std::memory_order_seq_cst) != 0)
+	{
+		std::unique_lock<std::mutex> lck(work_mutex);
+		lck.unlock();
+		work_cv.notify_all();
+	}
+}
+
+uint64_t globalStates::consume_work(msgstruct::miner_work& pWork)
+{
+	uint64_t iJobNo, iStamp;
+
+	while(true)
+	{
+		iJobNo = iGlobalJobNo.load(std::memory_order_acquire);
+		const work_slot& slot = aWorkSlot[iJobNo & 1];
+
+		const uint64_t iSeq = slot.iSeq.load(std::memory_order_acquire);
+		if((iSeq & 1) != 0)
+			continue;
+
+		// Field by field, miner_work's operator= asserts on a length a torn copy may hold
+		pWork.job_id_data = slot.oWork.job_id_data;
+		pWork.work_blob_data = slot.oWork.work_blob_data;
+		pWork.work_blob_len = slot.oWork.work_blob_len;
+		pWork.target_data = slot.oWork.target_data;
+		pWork.bStall = slot.oWork.bStall;
+		iStamp = slot.iPublishStamp;
+
+		// The slot may hold job iJobNo + 2 by now, then the data and the number don't match
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(slot.iSeq.load(std::memory_order_relaxed) == iSeq && iGlobalJobNo.load(std::memory_order_acquire) == iJobNo)
+			break;
+	}
+
+	if(iStamp != 0)
+		oSwitchLatency.record(get_timestamp_us() - iStamp);
+	return iJobNo;
+}
+
+void globalStates::wait_for_work(uint64_t iJobNo)
+{
+	iWaiters.fetch_add(1, std::memory_order_seq_cst);
+	std::unique_lock<std::mutex> lck(work_mutex);
+	work_cv.wait(lck, [&] { return iGlobalJobNo.load(std::memory_order_seq_cst) != iJobNo; });
+	lck.unlock();
+	iWaiters.fetch_sub(1, std::memory_order_relaxed);
 }
 
 } // namepsace xmrstak
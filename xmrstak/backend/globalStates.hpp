@@ -2,7 +2,9 @@
 
 #include "environment.hpp"
 #include "console.hpp"
+#include "latency_histogram.hpp"
 #include "xmrstak/net/msgstruct.hpp"
+#include <condition_variable>
 #include <thread>
 #include <atomic>
 #include <mutex>
@@ -33,21 +35,47 @@ struct globalStates
 	//pool_data is in-out winapi style
 	void switch_work(msgstruct::miner_work& pWork, pool_data& dat);
 
+	// Copy the current job into pWork and return its number
+	uint64_t consume_work(msgstruct::miner_work& pWork);
+
+	// Block until a job newer than iJobNo has been published
+	void wait_for_work(uint64_t iJobNo);
+
 	inline void calc_start_nonce(uint32_t& nonce, uint32_t reserve_count)
 	{
 		nonce = iGlobalNonce.fetch_add(reserve_count);
 	}
 
-	msgstruct::miner_work oGlobalWork;
 	std::atomic<uint64_t> iGlobalJobNo;
-	std::atomic<uint64_t> iConsumeCnt;
 	std::atomic<uint32_t> iGlobalNonce;
-	uint64_t iThreadCount;
+
+	// Time from switch_work publishing a job to each thread picking it up
+	latency_histogram oSwitchLatency;
 
 private:
-	globalStates() : iThreadCount(0)
+	globalStates() : iGlobalJobNo(0), iGlobalNonce(0), iWaiters(0)
 	{
 	}
+
+	// Seqlock protected copy of a job. iSeq is odd while the executor is writing the slot,
+	// readers retry if it was odd or changed while they were copying.
+	struct work_slot
+	{
+		std::atomic<uint64_t> iSeq;
+		msgstruct::miner_work oWork;
+		uint64_t iPublishStamp;
+
+		work_slot() : iSeq(0), iPublishStamp(0) {}
+	};
+
+	// Job n lives in aWorkSlot[n & 1], so publishing job n+1 never touches the slot
+	// the threads are currently copying from
+	work_slot aWorkSlot[2];
+
+	// Only used to park stalled threads, the publisher takes it only when someone waits
+	std::atomic<uint32_t> iWaiters;
+	std::mutex work_mutex;
+	std::condition_variable work_cv;
 };
 
 } // namepsace xmrstak
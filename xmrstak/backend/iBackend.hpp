@@ -1,17 +1,73 @@
 #pragma once
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 
 namespace xmrstak
 {
-	struct iBackend
+	struct thd_stats_snapshot
+	{
+		uint64_t iHashCount = 0;
+		uint64_t iSharesFound = 0;
+		uint64_t iHashAbandoned = 0;
+		uint64_t iJobSwitches = 0;
+		uint64_t iStallMs = 0;
+		uint64_t iFinalHashes[4] = {0, 0, 0, 0};
+		uint64_t iFinalCycles[4] = {0, 0, 0, 0};
+	};
+
+	// Owned and written only by the mining thread, read by the executor on every perf tick.
+	// It sits on its own cache line(s) so that neighbouring backends, which thread_starter
+	// allocates back to back, never false-share with it. Single writer means we can bump the
+	// counters with a relaxed load/store pair instead of a locked read-modify-write.
+	struct alignas(64) thd_stats
 	{
 		std::atomic<uint64_t> iHashCount;
-		std::atomic<uint64_t> iTimestamp;
-		uint32_t iThreadNo;
+		std::atomic<uint64_t> iSharesFound;
+		std::atomic<uint64_t> iHashAbandoned;
+		std::atomic<uint64_t> iJobSwitches;
+		std::atomic<uint64_t> iStallMs;
+
+		// Copy of the thread's cn_final_stats, per finalizer: blake, groestl, jh, skein
+		std::atomic<uint64_t> iFinalHashes[4];
+		std::atomic<uint64_t> iFinalCycles[4];
+
+		thd_stats() : iHashCount(0), iSharesFound(0), iHashAbandoned(0), iJobSwitches(0), iStallMs(0)
+		{
+			for (size_t i = 0; i < 4; i++)
+			{
+				iFinalHashes[i].store(0, std::memory_order_relaxed);
+				iFinalCycles[i].store(0, std::memory_order_relaxed);
+			}
+		}
 
-		iBackend() : iHashCount(0), iTimestamp(0) {}
+		static inline void add(std::atomic<uint64_t>& ctr, uint64_t val)
+		{
+			ctr.store(ctr.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+		}
+
+		thd_stats_snapshot snapshot() const
+		{
+			thd_stats_snapshot out;
+			out.iHashCount = iHashCount.load(std::memory_order_relaxed);
+			out.iSharesFound = iSharesFound.load(std::memory_order_relaxed);
+			out.iHashAbandoned = iHashAbandoned.load(std::memory_order_relaxed);
+			out.iJobSwitches = iJobSwitches.load(std::memory_order_relaxed);
+			out.iStallMs = iStallMs.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < 4; i++)
+			{
+				out.iFinalHashes[i] = iFinalHashes[i].load(std::memory_order_relaxed);
+				out.iFinalCycles[i] = iFinalCycles[i].load(std::memory_order_relaxed);
+			}
+			return out;
+		}
+	};
+
+	struct iBackend
+	{
+		thd_stats oStats;
+		uint32_t iThreadNo;
 	};
 
 } // namepsace xmrstak
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace xmrstak
+{
+
+// Lock-free log2 histogram of latencies in microseconds.
+// Bucket i counts samples in [2^(i-1), 2^i), bucket 0 takes zero and the last bucket
+// everything above its lower bound. Writers only do a relaxed add, so it is cheap enough
+// to record from the mining threads.
+struct latency_histogram
+{
+	constexpr static size_t iBuckets = 32;
+
+	latency_histogram()
+	{
+		for(auto& b : aBuckets)
+			b.store(0, std::memory_order_relaxed);
+	}
+
+	inline void record(uint64_t iMicroSec)
+	{
+		size_t i = 0;
+		while(iMicroSec != 0 && i < iBuckets - 1)
+		{
+			iMicroSec >>= 1;
+			i++;
+		}
+		aBuckets[i].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	inline uint64_t count() const
+	{
+		uint64_t n = 0;
+		for(auto& b : aBuckets)
+			n += b.load(std::memory_order_relaxed);
+		return n;
+	}
+
+	// Upper bound (in us) of the bucket holding the given percentile, 0 if there are no samples
+	inline uint64_t percentile(double fPct) const
+	{
+		const uint64_t n = count();
+		if(n == 0)
+			return 0;
+
+		const uint64_t iRank = (uint64_t)(fPct / 100.0 * (n - 1));
+		uint64_t iSeen = 0;
+		for(size_t i = 0; i < iBuckets; i++)
+		{
+			iSeen += aBuckets[i].load(std::memory_order_relaxed);
+			if(iSeen > iRank)
+				return bucket_limit(i);
+		}
+		return bucket_limit(iBuckets - 1);
+	}
+
+	inline static uint64_t bucket_limit(size_t i)
+	{
+		return i == 0 ? 0 : (uint64_t(1) << i) - 1;
+	}
+
+	std::array<std::atomic<uint64_t>, iBuckets> aBuckets;
+};
+
+} // namepsace xmrstak
@@ -21,14 +21,19 @@
   *
   */
 
-#include "c_cryptonight/cryptonight_aesni.hpp"
+#include "c_cryptonight/cryptonight_kernels.hpp"
+#include "c_cryptonight/cryptonight_pool.hpp"
 #include "console.hpp"
 #include "xmrstak/backend/iBackend.hpp"
 #include "xmrstak/backend//globalStates.hpp"
 #include "executor.hpp"
 #include "minethd.hpp"
 #include "c_hwlock/do_hwlock.hpp"
+#include "c_hwlock/hwlocArena.hpp"
+#include "c_hwlock/hwlocTopology.hpp"
 #include "autoAdjust.hpp"
+#include "autoTune.hpp"
+#include "sched_policy.hpp"
 #include "xmrstak/system_constants.hpp"
 #include "xmrstak/net/time_utils.hpp"
 #include "xmrstak/net/msgstruct.hpp"
@@ -74,36 +79,56 @@ bool minethd::thd_setaffinity(std::thread::native_handle_type h, uint64_t cpu_id
 #endif
 }
 
-minethd::minethd(msgstruct::miner_work& pWork, size_t iNo, int iMultiway, int64_t affinity)
+// The loop work_main actually runs, asm only exists with hardware AES and up to CN_ASM_MULTIWAY
+static bool use_asm_loop(bool bAsmLoop, int iMultiway)
+{
+	return bAsmLoop && iMultiway <= CN_ASM_MULTIWAY && !cn_use_soft_aes();
+}
+
+const char* minethd::get_main_loop() const
+{
+	return use_asm_loop(bAsmLoop, iMultiway) ? "asm" : bPrefetch ? "prefetch" : "plain";
+}
+
+template<size_t N>
+void minethd::work_main() {
+	const cn_kernels& kernels = select_cn_kernels();
+	if constexpr(N <= CN_ASM_MULTIWAY)
+	{
+		if(use_asm_loop(bAsmLoop, N))
+			return multiway_work_main<N>(kernels.hash_asm_target[N - 1]);
+	}
+	multiway_work_main<N>(kernels.hash_target[cn_use_soft_aes()][bPrefetch][N - 1]);
+}
+
+template<size_t... N>
+constexpr std::array<minethd::work_main_fun, sizeof...(N)> minethd::work_main_table(std::index_sequence<N...>) {
+	return {{ &minethd::work_main<N + 1>... }};
+}
+
+minethd::minethd(msgstruct::miner_work& pWork, size_t iNo, int iMultiway, bool bPrefetch, bool bAsmLoop, int64_t affinity)
 {
 	oWork = pWork;
 	bQuit = 0;
 	iThreadNo = (uint8_t)iNo;
 	iJobNo = 0;
 	this->affinity = affinity;
+	this->bPrefetch = bPrefetch;
+	this->bAsmLoop = bAsmLoop;
 
 	std::unique_lock<std::mutex> lck(thd_aff_set);
 	std::future<void> order_guard = order_fix.get_future();
 
-	switch (iMultiway)
-	{
-	case 5:
-		oWorkThd = std::thread(&minethd::penta_work_main, this);
-		break;
-	case 4:
-		oWorkThd = std::thread(&minethd::quad_work_main, this);
-		break;
-	case 3:
-		oWorkThd = std::thread(&minethd::triple_work_main, this);
-		break;
-	case 2:
-		oWorkThd = std::thread(&minethd::double_work_main, this);
-		break;
-	case 1:
-	default:
-		oWorkThd = std::thread(&minethd::single_work_main, this);
-		break;
-	}
+	// work_main<1> ... work_main<CN_MAX_MULTIWAY>, built at compile time
+	static constexpr auto oWorkMains = work_main_table(std::make_index_sequence<CN_MAX_MULTIWAY>());
+
+	if(iMultiway < 1)
+		iMultiway = 1;
+	else if(iMultiway > CN_MAX_MULTIWAY)
+		iMultiway = CN_MAX_MULTIWAY;
+	this->iMultiway = iMultiway;
+
+	oWorkThd = std::thread(oWorkMains[iMultiway - 1], this);
 
 	order_guard.wait();
 
@@ -135,6 +160,14 @@ cryptonight_ctx* minethd::minethd_alloc_ctx()
 		ctx = cryptonight_alloc_ctx(1, 1, &msg);
 		if (msg.warning != NULL)
 			printer::print_msg(L0, "MEMORY ALLOC FAILED: %s", msg.warning);
+		if (ctx == NULL)
+		{
+			// No reserved large pages left, transparent huge pages still beat 4 KiB pages
+			msg.warning = NULL;
+			ctx = cryptonight_alloc_ctx(2, 0, &msg);
+			if (msg.warning != NULL)
+				printer::print_msg(L0, "MEMORY ALLOC WARNING: %s", msg.warning);
+		}
 		if (ctx == NULL)
 			ctx = cryptonight_alloc_ctx(0, 0, NULL);
 		return ctx;
@@ -149,7 +182,84 @@ cryptonight_ctx* minethd::minethd_alloc_ctx()
 	return nullptr; //Should never happen
 }
 
-static constexpr size_t MAX_N = 5;
+cryptonight_ctx* minethd::acquire_ctx(int64_t affinity)
+{
+	const int node = affinity >= 0 ? hwlocTopology::inst().numaNodeOf(affinity) : -1;
+	if(node >= 0)
+	{
+		uint8_t* slice = hwlocArena::inst().acquire(node);
+		if(slice != nullptr)
+		{
+			static const uint8_t aPages[hwlocArena::page_tier_count] = { cn_pages_gigantic, cn_pages_large, cn_pages_thp, cn_pages_small };
+			return cryptonight_wrap_ctx(slice, aPages[hwlocArena::inst().tierOf(slice)]);
+		}
+
+		if(::system_constants::GetScratchpadArena())
+			printer::print_msg(L1, "WARNING no scratchpad left on NUMA node %d, allocating one for CPU %d.", node, (int)affinity);
+	}
+	return cryptonight_pool::inst().acquire(node, minethd_alloc_ctx);
+}
+
+void minethd::release_ctx(cryptonight_ctx* ctx)
+{
+	if(ctx == nullptr)
+		return;
+
+	if(ctx->ctx_info[0] == 2 && hwlocArena::inst().release(ctx->long_state))
+		cryptonight_free_ctx(ctx);
+	else
+		cryptonight_pool::inst().release(ctx);
+}
+
+// One region per NUMA node, sized for the threads pinned on it
+static void reserve_scratchpad_arena(const std::vector<auto_thd_cfg>& configs)
+{
+	const ::system_constants::slow_mem_cfg slowMem = ::system_constants::GetSlowMemSetting();
+	if(!::system_constants::GetScratchpadArena() || slowMem == ::system_constants::always_use)
+		return;
+
+	const hwlocTopology& topo = hwlocTopology::inst();
+	std::vector<size_t> vSlices(topo.cpu().numa_count, 0);
+	for(const auto& config : configs)
+	{
+		const int node = config.affine_to_cpu >= 0 ? topo.numaNodeOf(config.affine_to_cpu) : -1;
+		if(node < 0)
+			continue;
+		if((size_t)node >= vSlices.size())
+			vSlices.resize(node + 1, 0);
+		vSlices[node] += config.low_power_mode;
+	}
+
+	// Slow memory tiers only with print_warning, never_use and no_mlck rather fail than run slow
+	const hwlocArena::page_tier first = ::system_constants::GetScratchpad1GPages() ? hwlocArena::pages_1g : hwlocArena::pages_2m;
+	const hwlocArena::page_tier last = slowMem == ::system_constants::print_warning ? hwlocArena::pages_4k : hwlocArena::pages_2m;
+
+	// Contexts left over from the self-test and the tuning trials hold large pages the arena needs
+	const size_t nFreed = cryptonight_pool::inst().clear();
+	if(nFreed != 0)
+		printer::print_msg(L1, "Scratchpad arena: freed %u idle scratchpads.", (unsigned)nFreed);
+
+	hwlocArena& arena = hwlocArena::inst();
+	arena.reserve(MONERO_MEMORY, vSlices, first, last, slowMem != ::system_constants::no_mlck);
+
+	for(const auto& usage : arena.usage())
+	{
+		printer::print_msg(L0, "Scratchpad arena: NUMA node %d, %u scratchpads on %s pages%s.", usage.node, (unsigned)usage.slices,
+			hwlocArena::tierName(usage.tier), usage.bound ? "" : ", WARNING not bound to the node");
+	}
+	for(size_t node = 0; node < vSlices.size(); node++)
+	{
+		if(vSlices[node] == 0)
+			continue;
+		bool bReserved = false;
+		for(const auto& usage : arena.usage())
+			bReserved |= usage.node == (int)node;
+		if(!bReserved)
+			printer::print_msg(L0, "Scratchpad arena: WARNING could not reserve NUMA node %u, its threads allocate separately.", (unsigned)node);
+	}
+}
+
+static constexpr size_t MAX_N = CN_MAX_MULTIWAY;
 bool minethd::self_test()
 {
 	if (!minethed_self_test::test_func_selector()) {
@@ -158,6 +268,9 @@ bool minethd::self_test()
 	if (!minethed_self_test::test_func_multi_selector()) {
 		return false;
 	}
+	if (!minethed_self_test::test_extra_hashes()) {
+		return false;
+	}
 	return true;
 }
 
@@ -169,12 +282,28 @@ std::vector<iBackend*> minethd::thread_starter(uint32_t threadOffset, msgstruct:
 	//load evenly we need to alternate single and double threads
 	auto _threads = auto_threads();
 
-	size_t i, n = _threads.processors_count;
+	const cn_kernels& kernels = select_cn_kernels();
+	printer::print_msg(L0, "Hash kernels: %s, %s AES.", kernels.name, cn_use_soft_aes() ? "software" : "hardware");
+
+	auto_tune(_threads);
+	reserve_scratchpad_arena(_threads.configs);
+
+	// The tuning trials ran up to CN_MAX_MULTIWAY lanes per thread, keep no more idle
+	// scratchpads than the threads will take. The arena, if reserved, has already emptied the pool.
+	size_t iLanes = 0;
+	for(const auto& config : _threads.configs)
+		iLanes += config.low_power_mode;
+	const size_t nTrimmed = cryptonight_pool::inst().trim(iLanes);
+	if(nTrimmed != 0)
+		printer::print_msg(L1, "Freed %u idle scratchpads left over from tuning.", (unsigned)nTrimmed);
+
+	size_t i, n = _threads.configs.size();
 	pvThreads.reserve(n);
 
 	for (i = 0; i < n; i++)
 	{
 		auto auto_config = _threads.configs[i];
+		const char* loop_name = use_asm_loop(auto_config.asm_loop, auto_config.low_power_mode) ? " asm" : auto_config.prefetch ? " prefetch" : "";
 
 		if(auto_config.affine_to_cpu >= 0)
 		{
@@ -182,12 +311,14 @@ std::vector<iBackend*> minethd::thread_starter(uint32_t threadOffset, msgstruct:
 			printer::print_msg(L1, "WARNING on MacOS thread affinity is only advisory.");
 #endif
 
-			printer::print_msg(L1, "Starting %dx thread, affinity: %d.", auto_config.low_power_mode, (int)auto_config.affine_to_cpu);
+			const hwlocTopology& topo = hwlocTopology::inst();
+			printer::print_msg(L1, "Starting %dx%s thread, affinity: %d, L3 domain: %d, NUMA node: %d.", auto_config.low_power_mode, loop_name,
+				(int)auto_config.affine_to_cpu, topo.l3DomainOf(auto_config.affine_to_cpu), topo.numaNodeOf(auto_config.affine_to_cpu));
 		}
 		else
-			printer::print_msg(L1, "Starting %dx thread, no affinity.", auto_config.low_power_mode);
+			printer::print_msg(L1, "Starting %dx%s thread, no affinity.", auto_config.low_power_mode, loop_name);
 		
-		minethd* thd = new minethd(pWork, i + threadOffset, auto_config.low_power_mode, auto_config.affine_to_cpu);
+		minethd* thd = new minethd(pWork, i + threadOffset, auto_config.low_power_mode, auto_config.prefetch, auto_config.asm_loop, auto_config.affine_to_cpu);
 		pvThreads.push_back(thd);
 	}
 
@@ -196,29 +327,8 @@ std::vector<iBackend*> minethd::thread_starter(uint32_t threadOffset, msgstruct:
 
 void minethd::consume_work()
 {
-	memcpy(&oWork, &globalStates::inst().inst().oGlobalWork, sizeof(msgstruct::miner_work));
-	iJobNo++;
-	globalStates::inst().inst().iConsumeCnt++;
-}
-
-void minethd::single_work_main() {
-	multiway_work_main<1>(cryptonight_double_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, !CONFIG_AES_OVERRIDE, false>);
-}
-
-	void minethd::double_work_main() {
-	multiway_work_main<2>(cryptonight_double_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, !CONFIG_AES_OVERRIDE, false>);
-}
-
-void minethd::triple_work_main() {
-	multiway_work_main<3>(cryptonight_triple_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, !CONFIG_AES_OVERRIDE, false>);
-}
-
-void minethd::quad_work_main() {
-	multiway_work_main<4>(cryptonight_quad_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, !CONFIG_AES_OVERRIDE, false>);
-}
-
-void minethd::penta_work_main() {
-	multiway_work_main<5>(cryptonight_penta_hash<MONERO_MASK, MONERO_ITER, MONERO_MEMORY, !CONFIG_AES_OVERRIDE, false>);
+	iJobNo = globalStates::inst().consume_work(oWork);
+	thd_stats::add(oStats.iJobSwitches, 1);
 }
 
 template<size_t N>
@@ -232,11 +342,14 @@ void minethd::prep_multiway_work(uint8_t *bWorkBlob, uint32_t **piNonce) {
 }
 
 template<size_t N>
-void minethd::multiway_work_main(cn_hash_fun_multi hash_fun_multi)
+void minethd::multiway_work_main(cn_hash_fun_target hash_fun_target)
 {
 	if(affinity >= 0) //-1 means no affinity
 		do_hwlock(affinity);
 
+	set_thread_sched_policy(::system_constants::GetThreadSchedSetting());
+	preempt_point oPreempt(::system_constants::GetThreadSchedSetting(), ::system_constants::GetThreadYieldEvery());
+
 	order_fix.set_value();
 	std::unique_lock<std::mutex> lck(thd_aff_set);
 	lck.release();
@@ -244,7 +357,6 @@ void minethd::multiway_work_main(cn_hash_fun_multi hash_fun_multi)
 
 	cryptonight_ctx *ctx[MAX_N];
 	uint64_t iCount = 0;
-	uint64_t *piHashVal[MAX_N];
 	uint32_t *piNonce[MAX_N];
 	uint8_t bHashOut[MAX_N * 32];
 	uint8_t bWorkBlob[sizeof(msgstruct::miner_work::work_blob_data) * MAX_N];
@@ -253,16 +365,23 @@ void minethd::multiway_work_main(cn_hash_fun_multi hash_fun_multi)
 
 	for (size_t i = 0; i < N; i++)
 	{
-		ctx[i] = minethd_alloc_ctx();
-		piHashVal[i] = (uint64_t*)(bHashOut + 32 * i + 24);
+		ctx[i] = acquire_ctx(affinity);
 		piNonce[i] = (i == 0) ? (uint32_t*)(bWorkBlob + 39) : nullptr;
 	}
 
+	std::string sPages;
+	for (size_t i = 0; i < N; i++)
+	{
+		if (ctx[i] == nullptr)
+			continue;
+		sPages += i == 0 ? "" : ", ";
+		sPages += cryptonight_pages_name(ctx[i]->ctx_info[2]);
+	}
+	printer::print_msg(L1, "Thread %d scratchpads: %s.", (int)iThreadNo, sPages.c_str());
+
 	if(!oWork.bStall)
 		prep_multiway_work<N>(bWorkBlob, piNonce);
 
-	globalStates::inst().iConsumeCnt++;
-
 	while (bQuit == 0)
 	{
 		if (oWork.bStall)
@@ -271,26 +390,22 @@ void minethd::multiway_work_main(cn_hash_fun_multi hash_fun_multi)
 			either because of network latency, or a socket problem. Since we are
 			raison d'etre of this software it us sensible to just wait until we have something*/
 
-			while (globalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) == iJobNo)
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			uint64_t iStallStart = get_timestamp_ms();
+			globalStates::inst().wait_for_work(iJobNo);
+			thd_stats::add(oStats.iStallMs, get_timestamp_ms() - iStallStart);
 
 			consume_work();
 			prep_multiway_work<N>(bWorkBlob, piNonce);
 			continue;
 		}
 
-		constexpr uint32_t nonce_chunk = 4096;
+		// A whole number of batches, otherwise the last batch of a chunk runs into the nonces
+		// calc_start_nonce hands to the next thread
+		constexpr uint32_t nonce_chunk = 4096 - 4096 % N;
 		int64_t nonce_ctr = 0;
 
 		while (globalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) == iJobNo)
 		{
-			if ((iCount++ & 0x7) == 0)  //Store stats every 8*N hashes
-			{
-				uint64_t iStamp = get_timestamp_ms();
-				iHashCount.store(iCount * N, std::memory_order_relaxed);
-				iTimestamp.store(iStamp, std::memory_order_relaxed);
-			}
-
 			nonce_ctr -= N;
 			if(nonce_ctr <= 0)
 			{
@@ -301,24 +416,36 @@ void minethd::multiway_work_main(cn_hash_fun_multi hash_fun_multi)
 			for (size_t i = 0; i < N; i++)
 				*piNonce[i] = ++iNonce;
 
-			hash_fun_multi(bWorkBlob, oWork.work_blob_len, bHashOut, ctx);
+			// Only lanes below target are written to bHashOut
+			const uint32_t iHits = hash_fun_target(bWorkBlob, oWork.work_blob_len, oWork.target_data, bHashOut, ctx);
 
-			for (size_t i = 0; i < N; i++)
+			size_t iFound = 0;
+			for (size_t i = 0; iHits != 0 && i < N; i++)
 			{
-				if (*piHashVal[i] < oWork.target_data)
+				if (iHits & (1u << i))
 				{
 					msgstruct_v2::result_int_t result_data;
 					memcpy(&result_data[0], bHashOut + 32 * i, sizeof(msgstruct_v2::result_int_t));
 
 					const msgstruct::job_result result(oWork.job_id_data, iNonce - N + 1 + i, result_data);
 					executor::inst()->push_event_job_result(result);
-				} else {
-					// TODO: Log the hash was abandoned
-					statsd::statsd_increment("ev.hash_abandoned");
+					iFound++;
 				}
 			}
 
-			std::this_thread::yield();
+			// Publish every batch, the reader takes the timestamp
+			iCount += N;
+			oStats.iHashCount.store(iCount, std::memory_order_relaxed);
+			thd_stats::add(oStats.iHashAbandoned, N - iFound);
+			if (iFound != 0)
+				thd_stats::add(oStats.iSharesFound, iFound);
+			for (size_t f = 0; f < 4; f++)
+			{
+				oStats.iFinalHashes[f].store(cn_final_stats.hashes[f], std::memory_order_relaxed);
+				oStats.iFinalCycles[f].store(cn_final_stats.cycles[f], std::memory_order_relaxed);
+			}
+
+			oPreempt.batch_done();
 		}
 
 		consume_work();
@@ -326,7 +453,7 @@ void minethd::multiway_work_main(cn_hash_fun_multi hash_fun_multi)
 	}
 
 	for (int i = 0; i < N; i++)
-		cryptonight_free_ctx(ctx[i]);
+		release_ctx(ctx[i]);
 }
 
 } // namespace cpu
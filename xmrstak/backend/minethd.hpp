@@ -4,10 +4,14 @@
 #include "xmrstak/backend/iBackend.hpp"
 #include "xmrstak/net/msgstruct.hpp"
 
+#include <array>
+#include <future>
 #include <iostream>
 #include <thread>
+#include <utility>
 #include <vector>
 #include <atomic>
+#include <mutex>
 
 namespace xmrstak
 {
@@ -22,22 +26,34 @@ public:
 	static bool thd_setaffinity(std::thread::native_handle_type h, uint64_t cpu_id);
 	static cryptonight_ctx* minethd_alloc_ctx();
 
+	// Scratchpad from the arena of the NUMA node the PU belongs to, else an idle one from the
+	// context pool, else minethd_alloc_ctx(). Give it back with release_ctx.
+	static cryptonight_ctx* acquire_ctx(int64_t affinity);
+	static void release_ctx(cryptonight_ctx* ctx);
+
+	// What thread_starter started the thread with, for reports
+	int get_multiway() const { return iMultiway; }
+	int64_t get_affinity() const { return affinity; }
+	const char* get_main_loop() const;
+
 private:
-	typedef void (*cn_hash_fun_multi)(const void*, size_t, void*, cryptonight_ctx**);
+	typedef uint32_t (*cn_hash_fun_target)(const void*, size_t, uint64_t, void*, cryptonight_ctx**);
+
+	minethd(msgstruct::miner_work& pWork, size_t iNo, int iMultiway, bool bPrefetch, bool bAsmLoop, int64_t affinity);
 
-	minethd(msgstruct::miner_work& pWork, size_t iNo, int iMultiway, int64_t affinity);
+	typedef void (minethd::*work_main_fun)();
 
 	template<size_t N>
-	void multiway_work_main(cn_hash_fun_multi hash_fun_multi);
+	void multiway_work_main(cn_hash_fun_target hash_fun_target);
 
 	template<size_t N>
 	void prep_multiway_work(uint8_t *bWorkBlob, uint32_t **piNonce);
 
-	void single_work_main();
-	void double_work_main();
-	void triple_work_main();
-	void quad_work_main();
-	void penta_work_main();
+	template<size_t N>
+	void work_main();
+
+	template<size_t... N>
+	static constexpr std::array<work_main_fun, sizeof...(N)> work_main_table(std::index_sequence<N...>);
 
 	void consume_work();
 
@@ -51,6 +67,9 @@ private:
 
 	std::thread oWorkThd;
 	int64_t affinity;
+	int iMultiway;
+	bool bPrefetch;
+	bool bAsmLoop;
 
 	bool bQuit;
 };
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "console.hpp"
+#include "xmrstak/system_constants.hpp"
+
+#include <thread>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace xmrstak
+{
+namespace cpu
+{
+
+// Apply the configured scheduling class to the calling thread. Must run on the mining
+// thread itself, on Linux sched_setscheduler(0, ...) only affects the caller.
+inline void set_thread_sched_policy(system_constants::thread_sched_cfg policy)
+{
+	if(policy != system_constants::sched_idle)
+		return;
+
+#if defined(__linux__) && defined(SCHED_IDLE)
+	sched_param param = { 0 };
+	if(sched_setscheduler(0, SCHED_IDLE, &param) != 0)
+		printer::print_msg(L1, "WARNING setting SCHED_IDLE failed.");
+#else
+	printer::print_msg(L1, "WARNING SCHED_IDLE is not supported on this OS, running at normal priority.");
+#endif
+}
+
+// Cooperative preemption point, called once per hash batch right before the job generation
+// is checked. Pinned miners don't need to give up their core, so by default this is free;
+// with sched_yield it calls sched_yield every iYieldEvery batches.
+class preempt_point
+{
+public:
+	preempt_point(system_constants::thread_sched_cfg policy, uint64_t iYieldEvery) :
+		iYieldEvery(policy == system_constants::sched_yield && iYieldEvery != 0 ? iYieldEvery : 0),
+		iBatch(0)
+	{
+	}
+
+	inline void batch_done()
+	{
+		if(iYieldEvery != 0 && ++iBatch >= iYieldEvery)
+		{
+			iBatch = 0;
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	const uint64_t iYieldEvery;
+	uint64_t iBatch;
+};
+
+} // namespace cpu
+} // namepsace xmrstak
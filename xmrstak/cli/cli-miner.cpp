@@ -24,6 +24,7 @@
 #include "xmrstak/backend/executor.hpp"
 #include "xmrstak/system_constants.hpp"
 #include "xmrstak/backend/minethd.hpp"
+#include "xmrstak/backend/benchmark.hpp"
 #include "xmrstak/net/time_utils.hpp"
 
 #include <stdlib.h>
@@ -36,6 +37,10 @@ int main(int argc, char *argv[])
 {
 	srand(time(0));
 
+	bool bBenchmark = false;
+	uint64_t iBenchSeconds = 60;
+	std::string sBenchJson;
+
 	for(size_t i = 1; i < argc; ++i) {
 		std::string opName(argv[i]);
 		if(opName.compare("--help") == 0) {
@@ -44,6 +49,9 @@ int main(int argc, char *argv[])
 			std::cout <<"  --help            show this help"<< std::endl;
 			std::cout <<"  --version         show version number"<< std::endl;
 			std::cout <<"  --version-long    show long version number"<< std::endl;
+			std::cout <<"  --benchmark [S]   mine a synthetic job for S seconds (default 60) without"<< std::endl;
+			std::cout <<"                    a pool and print H/s per thread"<< std::endl;
+			std::cout <<"  --json FILE       with --benchmark, write a JSON summary to FILE"<< std::endl;
 			std::cout << "Version: " << system_constants::get_version_str_short() <<  std::endl;
 			return 0;
 		} else if(opName.compare("--version") == 0) {
@@ -53,12 +61,30 @@ int main(int argc, char *argv[])
 		else if(opName.compare("--version-long") == 0) {
 			std::cout<< "Version: " << system_constants::get_version_str() << std::endl;
 			return 0;
+		} else if(opName.compare("--benchmark") == 0) {
+			bBenchmark = true;
+			if(i + 1 < argc && argv[i + 1][0] != '-')
+				iBenchSeconds = strtoull(argv[++i], nullptr, 10);
+		} else if(opName.compare("--json") == 0 && i + 1 < argc) {
+			sBenchJson = argv[++i];
 		} else {
 			std::cout << "Parameter unknown '%s'" << argv[i] << std::endl;
 			return 1;
 		}
 	}
 
+	if(!sBenchJson.empty() && !bBenchmark) {
+		std::cout << "--json is only used with --benchmark" << std::endl;
+		return 1;
+	}
+
+	if(bBenchmark) {
+		const int iRet = xmrstak::run_benchmark(iBenchSeconds, sBenchJson);
+		// The mining threads never return, leave without destroying the state they use
+		std::cout.flush();
+		_Exit(iRet);
+	}
+
 	if (!xmrstak::cpu::minethd::self_test()) {
 		return 1;
 	}
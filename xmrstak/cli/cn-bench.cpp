@@ -0,0 +1,433 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  */
+
+// Microbenchmarks of the hash kernel building blocks: scratchpad explode / implode per kernel
+// table and AES flavour, N contexts interleaved against one after the other, and the
+// multi-buffer Keccak-f against the scalar permutation, the SIMD finalizer hashes against
+// their portable C versions, the multi-buffer finalizers per number of states, the main loops
+// alone and whole N-way hashes with the plain, the prefetching and the asm main loops, the
+// saes_table round against soft_aesenc on every table, and the pool side of a job: hex2bin /
+// bin2hex and parsing the stratum JSON.
+//
+// Runs pinned to one PU. Every benchmark warms up untimed first, the tables show the median
+// TSC ticks per op, --json also writes the 10th / 90th / 99th percentiles of every benchmark
+// to a file, to compare commits.
+//
+// usage: cn-bench [--cpu PU] [--json FILE] [repetitions]
+
+#include "c_cryptonight/cryptonight.hpp"
+#include "c_cryptonight/cryptonight_kernels.hpp"
+#include "c_hwlock/hwlocTopology.hpp"
+#include "xmrstak/backend/autoAdjust.hpp"
+#include "xmrstak/net/msgstruct.hpp"
+#include "xmrstak/system_constants.hpp"
+#include "includes/json.hpp"
+
+#include <x86intrin.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct bench_id {
+		std::string sBench;	// what is timed, e.g. "explode"
+		std::string sKernels;	// kernel table name, or "-" for code outside the tables
+		std::string sVariant;	// AES flavour, main loop, C / SIMD...
+		size_t n;		// contexts / states / bytes per call, see the tables
+	};
+
+	struct bench_result {
+		uint64_t iMedian;	// TSC ticks per op
+		uint64_t iP10, iP90, iP99;
+		double fGBps;		// bytes per second over all timed calls
+	};
+
+	// Every run_bench lands here, written out by --json
+	nlohmann::json jResults = nlohmann::json::array();
+
+	// Untimed calls for at least 3 calls and 20 ms so caches, TLB, branch predictors and the
+	// clock are settled, then iReps timed calls. A call does iOps ops and touches iBytes bytes.
+	template<typename F>
+	bench_result run_bench(const bench_id& id, F&& fn, size_t iReps, size_t iOps = 1, size_t iBytes = 0) {
+		auto tWarm = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+		for (size_t i = 0; i < 3 || std::chrono::steady_clock::now() < tWarm; i++)
+			fn();
+
+		std::vector<uint64_t> vTicks;
+		vTicks.reserve(iReps);
+		auto tStart = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < iReps; i++) {
+			unsigned int aux;
+			uint64_t iStart = __rdtscp(&aux);
+			fn();
+			vTicks.push_back(__rdtscp(&aux) - iStart);
+		}
+		double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+
+		std::sort(vTicks.begin(), vTicks.end());
+		auto pct = [&](size_t p) { return vTicks[std::min(iReps - 1, iReps * p / 100)] / iOps; };
+		const bench_result r = { pct(50), pct(10), pct(90), pct(99), iBytes * (double)iReps / fSeconds / 1e9 };
+
+		nlohmann::json entry;
+		entry["bench"] = id.sBench;
+		entry["kernels"] = id.sKernels;
+		entry["variant"] = id.sVariant;
+		entry["n"] = id.n;
+		entry["median"] = r.iMedian;
+		entry["p10"] = r.iP10;
+		entry["p90"] = r.iP90;
+		entry["p99"] = r.iP99;
+		if (iBytes != 0)
+			entry["gbps"] = r.fGBps;
+		jResults.push_back(entry);
+		return r;
+	}
+
+	// Keeps the compiler from dropping stores to p that nothing reads afterwards
+	inline void bench_escape(const void* p) {
+		__asm__ __volatile__("" : : "r"(p) : "memory");
+	}
+
+	void pin_thread(unsigned pu) {
+		hwlocTopology& topo = hwlocTopology::inst();
+		if (topo.handle() == nullptr)
+			return;
+
+		hwloc_bitmap_t set = hwloc_bitmap_alloc();
+		hwloc_bitmap_only(set, pu);
+		if (hwloc_set_cpubind(topo.handle(), set, HWLOC_CPUBIND_THREAD) != 0)
+			std::cerr << "WARNING: could not pin to PU " << pu << ", timings will be noisy" << std::endl;
+		hwloc_bitmap_free(set);
+	}
+
+	cryptonight_ctx* bench_alloc_ctx() {
+		alloc_msg msg = { 0 };
+		cryptonight_ctx* ctx = cryptonight_alloc_ctx(1, 0, &msg);
+		if (ctx == NULL)
+			ctx = cryptonight_alloc_ctx(2, 0, &msg);
+		if (ctx == NULL)
+			ctx = cryptonight_alloc_ctx(0, 0, NULL);
+		return ctx;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	size_t iReps = 200;
+	unsigned iPu = 0;
+	std::string sJsonFile;
+	for (int i = 1; i < argc; i++) {
+		const std::string sArg(argv[i]);
+		if (sArg == "--cpu" && i + 1 < argc)
+			iPu = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+		else if (sArg == "--json" && i + 1 < argc)
+			sJsonFile = argv[++i];
+		else if (sArg[0] != '-')
+			iReps = std::max<size_t>(std::strtoull(sArg.c_str(), nullptr, 10), 1);
+		else {
+			std::cerr << "usage: cn-bench [--cpu PU] [--json FILE] [repetitions]" << std::endl;
+			return 1;
+		}
+	}
+
+	pin_thread(iPu);
+	const xmrstak::cpu::cpu_features features = xmrstak::cpu::get_cpu_features();
+
+	cryptonight_ctx* ctx[CN_MAX_MULTIWAY];
+	for (size_t n = 0; n < CN_MAX_MULTIWAY; n++) {
+		ctx[n] = bench_alloc_ctx();
+		for (size_t i = 0; i < sizeof(ctx[n]->hash_state); i++)
+			ctx[n]->hash_state[i] = (uint8_t)(i * 131 + n * 17 + 7);
+	}
+
+	// Tables this CPU can run, cn_get_kernels maps missing levels to a lower table
+	std::vector<const cn_kernels*> vKernels;
+	for (int level = 0; level < cn_isa_count; level++) {
+		const cn_kernels& kernels = cn_get_kernels((cn_isa_level)level);
+		if (xmrstak::cpu::cn_kernels_supported(features, (cn_isa_level)level) && kernels.level == level)
+			vKernels.push_back(&kernels);
+	}
+
+	std::cout << iReps << " repetitions on PU " << iPu << ", " << cryptonight_pages_name(ctx[0]->ctx_info[2]) << " pages, median TSC ticks" << std::endl;
+	std::cout << "| kernels | aes  | explode ticks  |  GB/s | implode ticks  |  GB/s |" << std::endl;
+
+	for (const cn_kernels* kernels : vKernels) {
+		for (int soft = features.aes ? 0 : 1; soft < 2; soft++) {
+			const char* sAes = soft ? "soft" : "hw";
+			const bench_result explode = run_bench({ "explode", kernels->name, sAes, 1 }, [&] { kernels->explode[soft](ctx[0]); }, iReps, 1, MONERO_MEMORY);
+			const bench_result implode = run_bench({ "implode", kernels->name, sAes, 1 }, [&] { kernels->implode[soft](ctx[0]); }, iReps, 1, MONERO_MEMORY);
+
+			char line[128];
+			snprintf(line, sizeof(line), "| %-7s | %-4s | %14llu | %5.2f | %14llu | %5.2f |", kernels->name, sAes,
+				(unsigned long long)explode.iMedian, explode.fGBps, (unsigned long long)implode.iMedian, implode.fGBps);
+			std::cout << line << std::endl;
+		}
+	}
+
+	// N contexts one after the other, as the kernels did before, against one interleaved pass
+	if (features.aes) {
+		std::cout << std::endl << "hardware AES, ticks per context" << std::endl;
+		std::cout << "| kernels | N | explode seq | explode ilv | implode seq | implode ilv |" << std::endl;
+
+		for (const cn_kernels* kernels : vKernels) {
+			for (size_t n = 1; n <= CN_MAX_MULTIWAY; n++) {
+				const size_t iBytes = MONERO_MEMORY * n;
+				const bench_result explode_seq = run_bench({ "explode", kernels->name, "hw sequential", n },
+					[&] { for (size_t i = 0; i < n; i++) kernels->explode[0](ctx[i]); }, iReps, n, iBytes);
+				const bench_result explode_ilv = run_bench({ "explode", kernels->name, "hw interleaved", n },
+					[&] { kernels->explode_multi[0][n - 1](ctx); }, iReps, n, iBytes);
+				const bench_result implode_seq = run_bench({ "implode", kernels->name, "hw sequential", n },
+					[&] { for (size_t i = 0; i < n; i++) kernels->implode[0](ctx[i]); }, iReps, n, iBytes);
+				const bench_result implode_ilv = run_bench({ "implode", kernels->name, "hw interleaved", n },
+					[&] { kernels->implode_multi[0][n - 1](ctx); }, iReps, n, iBytes);
+
+				char line[128];
+				snprintf(line, sizeof(line), "| %-7s | %zu | %11llu | %11llu | %11llu | %11llu |", kernels->name, n,
+					(unsigned long long)explode_seq.iMedian, (unsigned long long)explode_ilv.iMedian,
+					(unsigned long long)implode_seq.iMedian, (unsigned long long)implode_ilv.iMedian);
+				std::cout << line << std::endl;
+			}
+		}
+	}
+
+	// Keccak-1600 of a 76 byte blob to the 200 byte state, the first step of every hash
+	std::cout << std::endl << "keccak of 76 bytes, ticks" << std::endl;
+	std::cout << "| kernels | keccak |" << std::endl;
+
+	uint8_t bInput[76 * CN_MAX_MULTIWAY] = { 0 };
+	for (const cn_kernels* kernels : vKernels) {
+		uint8_t state[200];
+		const bench_result keccak = run_bench({ "keccak", kernels->name, "76 bytes", 1 }, [&] { kernels->keccak(bInput, 76, state, 200); }, iReps);
+
+		char line[128];
+		snprintf(line, sizeof(line), "| %-7s | %6llu |", kernels->name, (unsigned long long)keccak.iMedian);
+		std::cout << line << std::endl;
+	}
+
+	// Keccak-f[1600] on N states, the scalar permutation N times against one multi-buffer call
+	std::cout << std::endl << "keccakf, ticks per state" << std::endl;
+	std::cout << "| kernels | N | scalar | multi-buffer |" << std::endl;
+
+	uint64_t* st[CN_MAX_MULTIWAY];
+	for (size_t n = 0; n < CN_MAX_MULTIWAY; n++)
+		st[n] = (uint64_t*)ctx[n]->hash_state;
+
+	for (const cn_kernels* kernels : vKernels) {
+		for (size_t n = 1; n <= CN_MAX_MULTIWAY; n++) {
+			const bench_result scalar = run_bench({ "keccakf", kernels->name, "scalar", n },
+				[&] { for (size_t i = 0; i < n; i++) kernels->keccakf(st[i], 24); }, iReps, n);
+			const bench_result multi = run_bench({ "keccakf", kernels->name, "multi-buffer", n },
+				[&] { kernels->keccakf_multi(st, n, 24); }, iReps, n);
+
+			char line[128];
+			snprintf(line, sizeof(line), "| %-7s | %zu | %6llu | %12llu |", kernels->name, n,
+				(unsigned long long)scalar.iMedian, (unsigned long long)multi.iMedian);
+			std::cout << line << std::endl;
+		}
+	}
+
+	// The four finalizers on the 200 byte Keccak state, portable C against what the table dispatches to
+	std::cout << std::endl << "finalizers, ticks per 200 byte hash, C / table" << std::endl;
+	std::cout << "| kernels |     blake     |    groestl    |      jh       |     skein     |" << std::endl;
+
+	static const char* const finalizer_names[4] = { "blake", "groestl", "jh", "skein" };
+	std::vector<std::array<unsigned long long, 4>> vSingle;
+	for (const cn_kernels* kernels : vKernels) {
+		unsigned long long ref[4];
+		std::array<unsigned long long, 4> simd;
+		uint8_t out[32];
+		for (int f = 0; f < 4; f++) {
+			ref[f] = run_bench({ finalizer_names[f], kernels->name, "C", 1 },
+				[&] { kernels->extra_hashes_ref[f](ctx[0]->hash_state, 200, out); }, iReps).iMedian;
+			simd[f] = run_bench({ finalizer_names[f], kernels->name, "table", 1 },
+				[&] { kernels->extra_hashes[f](ctx[0]->hash_state, 200, out); }, iReps).iMedian;
+		}
+
+		char line[128];
+		snprintf(line, sizeof(line), "| %-7s | %5llu / %5llu | %5llu / %5llu | %5llu / %5llu | %5llu / %5llu |", kernels->name,
+			ref[0], simd[0], ref[1], simd[1], ref[2], simd[2], ref[3], simd[3]);
+		std::cout << line << std::endl;
+		vSingle.push_back(simd);
+	}
+
+	// The finalizer stage hands each finalizer all states of a batch that select it, n of them.
+	// single is the table column of the C / table run above, same state and call.
+	std::cout << std::endl << "finalizers multi-buffer, ticks per 200 byte hash for n states" << std::endl;
+	std::cout << "| kernels | hash    | single |  n=1 |  n=2 |  n=3 |  n=4 |  n=8 |" << std::endl;
+
+	static const size_t finalizer_n[5] = { 1, 2, 3, 4, 8 };
+	const uint8_t* pIn[CN_MAX_MULTIWAY];
+	uint8_t* pOut[CN_MAX_MULTIWAY];
+	uint8_t bOut[32 * CN_MAX_MULTIWAY];
+	for (size_t n = 0; n < CN_MAX_MULTIWAY; n++)
+	{
+		pIn[n] = ctx[n]->hash_state;
+		pOut[n] = bOut + 32 * n;
+	}
+
+	for (size_t k = 0; k < vKernels.size(); k++) {
+		const cn_kernels* kernels = vKernels[k];
+		for (int f = 0; f < 4; f++) {
+			unsigned long long multi[5];
+			const unsigned long long single = vSingle[k][f];
+			for (size_t i = 0; i < 5; i++) {
+				const size_t n = finalizer_n[i];
+				multi[i] = run_bench({ finalizer_names[f], kernels->name, "multi-buffer", n },
+					[&] { kernels->extra_hashes_multi[f](pIn, 200, pOut, n); }, iReps, n).iMedian;
+			}
+
+			char line[128];
+			snprintf(line, sizeof(line), "| %-7s | %-7s | %6llu | %4llu | %4llu | %4llu | %4llu | %4llu |", kernels->name, finalizer_names[f],
+				single, multi[0], multi[1], multi[2], multi[3], multi[4]);
+			std::cout << line << std::endl;
+		}
+	}
+
+	// The table the miner picks, the main loop alone and whole hashes: plain main loop against
+	// the one that prefetches each lane's next scratchpad line as soon as its address is known
+	// and the asm loops
+	const cn_kernels& selected = xmrstak::cpu::select_cn_kernels();
+	const int soft_aes = xmrstak::cpu::cn_use_soft_aes();
+	const char* sAes = soft_aes ? "soft" : "hw";
+	for (int whole = 0; whole < 2; whole++) {
+		const char* sBench = whole ? "hash" : "main loop";
+		std::cout << std::endl << selected.name << " " << sAes << " AES, " << sBench << " ticks per hash" << std::endl;
+		std::cout << "| N |    plain | prefetch | speedup |      asm | speedup |" << std::endl;
+
+		selected.explode_multi[soft_aes][CN_MAX_MULTIWAY - 1](ctx);
+		for (size_t n = 1; n <= CN_MAX_MULTIWAY; n++) {
+			const size_t iHashReps = std::max<size_t>(iReps / n, 3);
+			auto run = [&](const char* sVariant, int prefetch, bool bAsm) {
+				return run_bench({ sBench, selected.name, std::string(sAes) + " " + sVariant, n }, [&] {
+					if (whole)
+						(bAsm ? selected.hash_asm[n - 1] : selected.hash[soft_aes][prefetch][n - 1])(bInput, 76, bOut, ctx);
+					else
+						(bAsm ? selected.main_loop_asm[n - 1] : selected.main_loop[soft_aes][prefetch][n - 1])(ctx);
+				}, iHashReps, n);
+			};
+			const bench_result plain = run("plain", 0, false);
+			const bench_result prefetch = run("prefetch", 1, false);
+
+			char line[128];
+			int iLen = snprintf(line, sizeof(line), "| %zu | %8llu | %8llu | %6.3fx |", n, (unsigned long long)plain.iMedian,
+				(unsigned long long)prefetch.iMedian, (double)plain.iMedian / prefetch.iMedian);
+			if (!soft_aes && n <= CN_ASM_MULTIWAY) {
+				const bench_result asm_loop = run("asm", 0, true);
+				snprintf(line + iLen, sizeof(line) - iLen, " %8llu | %6.3fx |", (unsigned long long)asm_loop.iMedian,
+					(double)plain.iMedian / asm_loop.iMedian);
+			} else {
+				snprintf(line + iLen, sizeof(line) - iLen, "        - |       - |");
+			}
+			std::cout << line << std::endl;
+		}
+	}
+
+	// The two software AES rounds on every table: saes_table lookups against soft_aesenc, which
+	// is the same code on sse2 and the SSSE3 pshufb round from avx up. The round is timed as a
+	// dependent chain, its latency, and in the soft AES main loop, where the N lanes have
+	// independent chains to overlap.
+	static const size_t iChain = 1024;
+	static const size_t soft_n[4] = { 1, 2, 4, 8 };
+	std::cout << std::endl << "software AES, table / soft_aesenc, ticks per round and per main loop" << std::endl;
+	std::cout << "| kernels | soft_aesenc | round       | main loop 1x        | main loop 2x        | main loop 4x        | main loop 8x        |" << std::endl;
+	for (const cn_kernels* kernels : vKernels) {
+		const char* sSoft = kernels->level == cn_isa_sse2 ? "table" : "pshufb";
+		uint8_t bBlock[16] = { 0 }, bKey[16] = { 0 };
+		unsigned long long round[2], loop[2][4];
+		for (int v = 0; v < 2; v++) {
+			const char* sVariant = v ? "soft_aesenc" : "saes_table";
+			round[v] = run_bench({ "soft aes round", kernels->name, sVariant, 1 },
+				[&] { kernels->soft_aesenc_chain[v](bBlock, bKey, iChain); }, iReps, iChain).iMedian;
+
+			for (size_t i = 0; i < 4; i++) {
+				const size_t n = soft_n[i];
+				kernels->explode_multi[1][n - 1](ctx);
+				loop[v][i] = run_bench({ "main loop", kernels->name, sVariant, n },
+					[&] { (v ? kernels->main_loop[1][0][n - 1] : kernels->main_loop_soft_table[n - 1])(ctx); },
+					std::max<size_t>(iReps / 4 / n, 3), n).iMedian;
+			}
+		}
+		bench_escape(bBlock);
+
+		char line[192];
+		snprintf(line, sizeof(line), "| %-7s | %-11s | %4llu / %4llu | %8llu / %8llu | %8llu / %8llu | %8llu / %8llu | %8llu / %8llu |",
+			kernels->name, sSoft, round[0], round[1], loop[0][0], loop[1][0], loop[0][1], loop[1][1],
+			loop[0][2], loop[1][2], loop[0][3], loop[1][3]);
+		std::cout << line << std::endl;
+	}
+
+	// What a pool job costs before the hash threads see it: the stratum line through
+	// nlohmann::json and the checks of jpsock::process_pool_job_new_style, and the hex
+	// conversions of a 76 byte blob both ways
+	static const char sJobLine[] = "{\"jsonrpc\":\"2.0\",\"method\":\"job\",\"params\":{"
+		"\"blob\":\"0707f7a4f0d605b303260816ba3f10902e1a145ac5fad3aa3af6ea44c11869dc4f853f002b2eea0000000077b206a02ca5b1d4ce6bbfdf0acac38bded34d2dcdeef95cd20cefc12f61d56109\","
+		"\"job_id\":\"q7PLUPL25UV0z5Ij14IyMk8htXbj\",\"target\":\"b88d0600\",\"height\":1523740}}";
+	std::cout << std::endl << "pool job, ticks" << std::endl;
+	std::cout << "| json job parse | hex2bin 76 B | bin2hex 76 B |" << std::endl;
+
+	msgstruct::pool_job oPoolJob;
+	const bench_result parse = run_bench({ "job parse", "-", "nlohmann::json", sizeof(sJobLine) - 1 }, [&] {
+		const nlohmann::json data = nlohmann::json::parse(sJobLine);
+		const nlohmann::json& params = data["params"];
+		if (!params.is_object() || !params["job_id"].is_string() || !params["blob"].is_string() || !params["target"].is_string())
+			std::abort();
+		oPoolJob.set_target(params["target"].get<std::string>());
+		if (oPoolJob.i_job_diff() == 0 || !oPoolJob.set_blob(params["blob"].get<std::string>()))
+			std::abort();
+		oPoolJob.set_job_id(params["job_id"].get<std::string>());
+	}, iReps);
+
+	char sHex[76 * 2];
+	msgstruct_v2::utils::bin2hex(oPoolJob.get_work_blob_data().data(), 76, sHex);
+	const bench_result hex2bin = run_bench({ "hex2bin", "-", "msgstruct_v2", 76 },
+		[&] { msgstruct_v2::utils::hex2bin(sHex, sizeof(sHex), bInput); bench_escape(bInput); }, iReps);
+	const bench_result bin2hex = run_bench({ "bin2hex", "-", "msgstruct_v2", 76 },
+		[&] { msgstruct_v2::utils::bin2hex(bInput, 76, sHex); bench_escape(sHex); }, iReps);
+
+	char line[128];
+	snprintf(line, sizeof(line), "| %14llu | %12llu | %12llu |", (unsigned long long)parse.iMedian,
+		(unsigned long long)hex2bin.iMedian, (unsigned long long)bin2hex.iMedian);
+	std::cout << line << std::endl;
+
+	if (!sJsonFile.empty()) {
+		nlohmann::json report;
+		report["version"] = system_constants::get_version_str();
+		report["selected"] = selected.name;
+		report["soft_aes"] = (bool)soft_aes;
+		report["pu"] = iPu;
+		report["repetitions"] = iReps;
+		report["pages"] = cryptonight_pages_name(ctx[0]->ctx_info[2]);
+		report["unit"] = "TSC ticks per op";
+		report["results"] = jResults;
+
+		std::ofstream out(sJsonFile);
+		out << report.dump(4) << std::endl;
+		if (!out) {
+			std::cerr << "ERROR: could not write " << sJsonFile << std::endl;
+			return 1;
+		}
+	}
+
+	for (size_t n = 0; n < CN_MAX_MULTIWAY; n++)
+		cryptonight_free_ctx(ctx[n]);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  */
+
+// Compares hash throughput with the scratchpad arena on every page size tier, one pinned
+// thread per core hashing N-way from the arena region of its NUMA node.
+//
+// usage: page-bench [seconds per tier] [multiway]
+
+#include "c_cryptonight/cryptonight.hpp"
+#include "c_cryptonight/cryptonight_kernels.hpp"
+#include "c_hwlock/hwlocArena.hpp"
+#include "c_hwlock/hwlocTopology.hpp"
+#include "xmrstak/backend/autoAdjust.hpp"
+#include "xmrstak/net/time_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	void pin_thread(unsigned pu) {
+		hwlocTopology& topo = hwlocTopology::inst();
+		if (topo.handle() == nullptr)
+			return;
+
+		hwloc_bitmap_t set = hwloc_bitmap_alloc();
+		hwloc_bitmap_only(set, pu);
+		hwloc_set_cpubind(topo.handle(), set, HWLOC_CPUBIND_THREAD);
+		hwloc_bitmap_free(set);
+	}
+
+	void hash_main(hwlocArena& arena, unsigned pu, int N, std::atomic<bool>& bStop, std::atomic<uint64_t>& iHashes) {
+		pin_thread(pu);
+
+		const cn_hash_fun_multi hash_fun = xmrstak::cpu::select_cn_kernels().hash[xmrstak::cpu::cn_use_soft_aes()][0][N - 1];
+		const int node = std::max(hwlocTopology::inst().numaNodeOf(pu), 0);
+		cryptonight_ctx* ctx[CN_MAX_MULTIWAY];
+		uint8_t bWorkBlob[76 * CN_MAX_MULTIWAY] = { 0 };
+		uint8_t bHashOut[32 * CN_MAX_MULTIWAY];
+		uint32_t* piNonce = (uint32_t*)(bWorkBlob + 39);
+		uint64_t iCount = 0;
+
+		for (int i = 0; i < N; i++)
+			ctx[i] = cryptonight_wrap_ctx(arena.acquire(node), cn_pages_small);
+
+		while (!bStop.load(std::memory_order_relaxed)) {
+			(*piNonce)++;
+			hash_fun(bWorkBlob, 76, bHashOut, ctx);
+			iCount += N;
+		}
+
+		iHashes += iCount;
+		for (int i = 0; i < N; i++) {
+			arena.release(ctx[i]->long_state);
+			cryptonight_free_ctx(ctx[i]);
+		}
+	}
+
+	// H/s on one tier, 0 if a node could not get pages of that size
+	double run_tier(hwlocArena::page_tier tier, const std::vector<unsigned>& vPus, int N, uint64_t iSeconds) {
+		const hwlocTopology& topo = hwlocTopology::inst();
+		std::vector<size_t> vSlices;
+		for (unsigned pu : vPus) {
+			const size_t node = std::max(topo.numaNodeOf(pu), 0);
+			if (node >= vSlices.size())
+				vSlices.resize(node + 1, 0);
+			vSlices[node] += N;
+		}
+
+		hwlocArena arena;
+		arena.reserve(MONERO_MEMORY, vSlices, tier, tier, false);
+
+		size_t nNodes = 0;
+		for (size_t slices : vSlices)
+			nNodes += slices != 0;
+		if (arena.usage().size() != nNodes)
+			return 0.0;
+
+		std::atomic<bool> bStop(false);
+		std::atomic<uint64_t> iHashes(0);
+		std::vector<std::thread> vThreads;
+
+		uint64_t iStart = get_timestamp_ms();
+		for (unsigned pu : vPus)
+			vThreads.emplace_back(hash_main, std::ref(arena), pu, N, std::ref(bStop), std::ref(iHashes));
+
+		std::this_thread::sleep_for(std::chrono::seconds(iSeconds));
+		bStop = true;
+		for (auto& thd : vThreads)
+			thd.join();
+
+		return iHashes.load() * 1000.0 / (get_timestamp_ms() - iStart);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const uint64_t iSeconds = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10;
+	const int N = std::min(std::max(argc > 2 ? std::atoi(argv[2]) : 1, 1), CN_MAX_MULTIWAY);
+
+	// First PU of every core, SMT siblings would only blur the comparison
+	std::vector<unsigned> vPus;
+	for (const auto& core : hwlocTopology::inst().cpu().cores)
+		vPus.push_back(core.pus[0]);
+
+	std::cout << "threads: " << vPus.size() << ", " << N << "x, " << iSeconds << " s per tier" << std::endl;
+	std::cout << "| pages            |      H/s |" << std::endl;
+
+	for (int tier = hwlocArena::pages_1g; tier < hwlocArena::page_tier_count; tier++) {
+		const double fRate = run_tier((hwlocArena::page_tier)tier, vPus, N, iSeconds);
+		char line[128];
+		if (fRate > 0.0)
+			snprintf(line, sizeof(line), "| %-16s | %8.1f |", hwlocArena::tierName((hwlocArena::page_tier)tier), fRate);
+		else
+			snprintf(line, sizeof(line), "| %-16s | %8s |", hwlocArena::tierName((hwlocArena::page_tier)tier), "n/a");
+		std::cout << line << std::endl;
+	}
+
+	return 0;
+}
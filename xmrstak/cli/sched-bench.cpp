@@ -0,0 +1,126 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  */
+
+// Compares hash throughput of the mining thread scheduling policies, once on an otherwise
+// idle box and once with one competing busy thread per core.
+
+#include "c_cryptonight/cryptonight.hpp"
+#include "c_cryptonight/cryptonight_kernels.hpp"
+#include "c_cryptonight/cryptonight_pool.hpp"
+#include "xmrstak/backend/autoAdjust.hpp"
+#include "xmrstak/backend/sched_policy.hpp"
+#include "xmrstak/net/time_utils.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct bench_policy {
+		const char* name;
+		system_constants::thread_sched_cfg policy;
+		uint64_t iYieldEvery;
+	};
+
+	cryptonight_ctx* bench_alloc_ctx() {
+		alloc_msg msg = { 0 };
+		cryptonight_ctx* ctx = cryptonight_alloc_ctx(1, 0, &msg);
+		if (ctx == NULL)
+			ctx = cryptonight_alloc_ctx(0, 0, NULL);
+		return ctx;
+	}
+
+	void hash_main(const bench_policy& cfg, std::atomic<bool>& bStop, std::atomic<uint64_t>& iHashes) {
+		xmrstak::cpu::set_thread_sched_policy(cfg.policy);
+		xmrstak::cpu::preempt_point oPreempt(cfg.policy, cfg.iYieldEvery);
+
+		const cn_hash_fun_multi hash_fun = xmrstak::cpu::select_cn_kernels().hash[xmrstak::cpu::cn_use_soft_aes()][0][0];
+		// Every policy run reuses the scratchpads of the previous one
+		cryptonight_ctx* ctx = cryptonight_pool::inst().acquire(-1, bench_alloc_ctx);
+		uint8_t bWorkBlob[76] = { 0 };
+		uint8_t bHashOut[32];
+		uint32_t* piNonce = (uint32_t*)(bWorkBlob + 39);
+		uint64_t iCount = 0;
+
+		while (!bStop.load(std::memory_order_relaxed)) {
+			(*piNonce)++;
+			hash_fun(bWorkBlob, sizeof(bWorkBlob), bHashOut, &ctx);
+			iCount++;
+			oPreempt.batch_done();
+		}
+
+		iHashes += iCount;
+		cryptonight_pool::inst().release(ctx);
+	}
+
+	double run_policy(const bench_policy& cfg, size_t nThreads, uint64_t iSeconds) {
+		std::atomic<bool> bStop(false);
+		std::atomic<uint64_t> iHashes(0);
+		std::vector<std::thread> vThreads;
+
+		uint64_t iStart = get_timestamp_ms();
+		for (size_t i = 0; i < nThreads; i++)
+			vThreads.emplace_back(hash_main, std::cref(cfg), std::ref(bStop), std::ref(iHashes));
+
+		std::this_thread::sleep_for(std::chrono::seconds(iSeconds));
+		bStop = true;
+		for (auto& thd : vThreads)
+			thd.join();
+
+		return iHashes.load() * 1000.0 / (get_timestamp_ms() - iStart);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const uint64_t iSeconds = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10;
+	const size_t nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	const bench_policy aPolicies[] = {
+		{ "yield every batch", system_constants::sched_yield, 1 },
+		{ "no yield", system_constants::sched_none, 0 },
+		{ "yield every 16", system_constants::sched_yield, 16 },
+		{ "SCHED_IDLE", system_constants::sched_idle, 0 }
+	};
+
+	std::cout << "threads: " << nThreads << ", " << iSeconds << " s per run" << std::endl;
+	std::cout << "| load   | policy             |      H/s |" << std::endl;
+
+	for (int loaded = 0; loaded < 2; loaded++) {
+		// Competing work: one busy spinning thread per core at normal priority
+		std::atomic<bool> bStopLoad(false);
+		std::vector<std::thread> vLoad;
+		if (loaded) {
+			for (size_t i = 0; i < nThreads; i++)
+				vLoad.emplace_back([&bStopLoad] { while (!bStopLoad.load(std::memory_order_relaxed)); });
+		}
+
+		for (const auto& cfg : aPolicies) {
+			char line[128];
+			snprintf(line, sizeof(line), "| %-6s | %-18s | %8.1f |", loaded ? "loaded" : "idle", cfg.name, run_policy(cfg, nThreads, iSeconds));
+			std::cout << line << std::endl;
+		}
+
+		bStopLoad = true;
+		for (auto& thd : vLoad)
+			thd.join();
+	}
+
+	return 0;
+}
@@ -7,8 +7,14 @@
 #include "includes/json.hpp"
 #include "xmrstak/system_constants.hpp"
 #include "includes/date/date.h"
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace statsd {
 
@@ -20,44 +26,189 @@ namespace statsd {
 	}
 
 
-	std::shared_ptr<Statsd::StatsdClient> get_client() {
-		return std::shared_ptr<Statsd::StatsdClient>(
-				new Statsd::StatsdClient(
-						system_constants::get_statsd_address(),
-						system_constants::get_statsd_port(),
-						system_constants::get_statsd_prefix()
-				)
+	// Process-wide metrics registry.
+	// Counters are sharded per thread and padded to a cache line so that mining threads never
+	// share a line with each other; gauges keep only their latest value. Nothing here touches a
+	// socket on the caller's thread - the flush thread owns the two pre-resolved statsd clients.
+	class registry {
+	public:
+		static registry& inst() {
+			// Leaked on purpose, the flush thread outlives static destruction
+			static registry* reg = new registry;
+			return *reg;
+		}
+
+		// Ids never change once handed out, so every thread keeps its own copy of the ones it
+		// used and only takes names_mutex the first time it sees a key
+		size_t counter_id(const std::string &key) {
+			thread_local std::unordered_map<std::string, size_t> cache;
+			return cached_lookup(cache, key, counter_ids, counter_names, counter_cnt);
+		}
+
+		size_t gauge_id(const std::string &key) {
+			thread_local std::unordered_map<std::string, size_t> cache;
+			return cached_lookup(cache, key, gauge_ids, gauge_names, gauge_cnt);
+		}
+
+		inline void count(size_t id, int64_t delta) {
+			shards[shard_no()].value[id].fetch_add(delta, std::memory_order_relaxed);
+		}
+
+		inline void gauge(size_t id, uint64_t value) {
+			gauges[id].value.store(value, std::memory_order_relaxed);
+			gauges[id].dirty.store(true, std::memory_order_release);
+		}
+
+		// Timings can't be pre-aggregated without losing the distribution, send them as they come
+		void timing(const std::string &key, unsigned int ms, float frequency) {
+			std::unique_lock<std::mutex> lck(client_mutex);
+			client.timing(key, ms, frequency);
+			instance_client.timing(key, ms, frequency);
+		}
+
+		static constexpr size_t iMaxMetrics = 64;
+		static constexpr size_t iInvalidId = iMaxMetrics;
+
+	private:
+		static constexpr size_t iMaxShards = 64;
+
+		struct alignas(64) shard {
+			std::atomic<int64_t> value[iMaxMetrics];
+		};
+
+		struct alignas(64) gauge_slot {
+			std::atomic<uint64_t> value;
+			std::atomic<bool> dirty;
+		};
+
+		registry() :
+				client(system_constants::get_statsd_address(), system_constants::get_statsd_port(),
+					   system_constants::get_statsd_prefix()),
+				instance_client(system_constants::get_statsd_address(), system_constants::get_statsd_port(),
+								system_constants::get_statsd_machine_prefix()),
+				counter_cnt(0), gauge_cnt(0), shard_cnt(0) {
+			for (size_t i = 0; i < iMaxShards; i++)
+				for (size_t j = 0; j < iMaxMetrics; j++)
+					shards[i].value[j].store(0, std::memory_order_relaxed);
+			for (size_t j = 0; j < iMaxMetrics; j++) {
+				gauges[j].value.store(0, std::memory_order_relaxed);
+				gauges[j].dirty.store(false, std::memory_order_relaxed);
+			}
+
+			std::thread(&registry::flush_main, this).detach();
+		}
+
+		inline size_t shard_no() {
+			thread_local size_t iShard = shard_cnt.fetch_add(1, std::memory_order_relaxed) % iMaxShards;
+			return iShard;
+		}
+
+		size_t cached_lookup(std::unordered_map<std::string, size_t> &cache, const std::string &key,
+							 std::unordered_map<std::string, size_t> &ids,
+							 std::array<std::string, iMaxMetrics> &names, std::atomic<size_t> &cnt) {
+			auto it = cache.find(key);
+			if (it != cache.end())
+				return it->second;
+
+			// A full registry stays full, so a dropped key is cached as dropped too
+			const size_t id = lookup(key, ids, names, cnt);
+			cache.emplace(key, id);
+			return id;
+		}
+
+		size_t lookup(const std::string &key, std::unordered_map<std::string, size_t> &ids,
+					  std::array<std::string, iMaxMetrics> &names, std::atomic<size_t> &cnt) {
+			std::unique_lock<std::mutex> lck(names_mutex);
+			auto it = ids.find(key);
+			if (it != ids.end())
+				return it->second;
+
+			size_t id = cnt.load(std::memory_order_relaxed);
+			if (id == iMaxMetrics) {
+				if (!bFullLogged) {
+					bFullLogged = true;
+					std::cerr << __FILE__ << ":" << __LINE__ << ":statsd: registry full (" << iMaxMetrics
+							  << " names), dropping key=" << key << " and every new key after it" << std::endl;
+				}
+				return iInvalidId;
+			}
+
+			names[id] = key;
+			ids.emplace(key, id);
+			cnt.store(id + 1, std::memory_order_release);
+			return id;
+		}
+
+		void flush_main() {
+			const auto interval = std::chrono::milliseconds(system_constants::get_statsd_flush_interval());
+			while (true) {
+				std::this_thread::sleep_for(interval);
+				flush();
+			}
+		}
+
+		void flush() {
+			const size_t nCounters = counter_cnt.load(std::memory_order_acquire);
+			const size_t nGauges = gauge_cnt.load(std::memory_order_acquire);
+
+			std::unique_lock<std::mutex> lck(client_mutex);
+			for (size_t id = 0; id < nCounters; id++) {
+				int64_t delta = 0;
+				for (size_t i = 0; i < iMaxShards; i++)
+					delta += shards[i].value[id].exchange(0, std::memory_order_relaxed);
+				if (delta == 0)
+					continue;
+
+				client.count(counter_names[id], (int)delta);
+				instance_client.count(counter_names[id], (int)delta);
+			}
+
+			for (size_t id = 0; id < nGauges; id++) {
+				if (!gauges[id].dirty.exchange(false, std::memory_order_acquire))
+					continue;
+
+				unsigned int value = (unsigned int)gauges[id].value.load(std::memory_order_relaxed);
+				client.gauge(gauge_names[id], value);
+				instance_client.gauge(gauge_names[id], value);
+			}
+		}
+
+		shard shards[iMaxShards];
+		gauge_slot gauges[iMaxMetrics];
+
+		Statsd::StatsdClient client;
+		Statsd::StatsdClient instance_client;
+		std::mutex client_mutex;
+
+		std::mutex names_mutex;
+		std::unordered_map<std::string, size_t> counter_ids;
+		std::unordered_map<std::string, size_t> gauge_ids;
+		std::array<std::string, iMaxMetrics> counter_names;
+		std::array<std::string, iMaxMetrics> gauge_names;
+		std::atomic<size_t> counter_cnt;
+		std::atomic<size_t> gauge_cnt;
+		bool bFullLogged = false;	// under names_mutex
+
+		std::atomic<size_t> shard_cnt;
+	};
+
+
+	// The logger keeps its socket open between events, sends are serialized by the mutex
+	void send_log(const std::string &cmd_buffer) {
+		static std::mutex logger_mutex;
+		static Statsd::UDPSender* logger = new Statsd::UDPSender(
+				system_constants::get_logging_address(),
+				system_constants::get_logging_port()
 		);
-	}
-
-	std::shared_ptr<Statsd::StatsdClient> get_instance_client() {
-		return std::shared_ptr<Statsd::StatsdClient>(
-				new Statsd::StatsdClient(
-						system_constants::get_statsd_address(),
-						system_constants::get_statsd_port(),
-						system_constants::get_statsd_machine_prefix()
-				)
-		);
-	}
-
 
-	std::shared_ptr<Statsd::UDPSender> get_logger() {
-		std::shared_ptr<Statsd::UDPSender> output = std::shared_ptr<Statsd::UDPSender>(
-				new Statsd::UDPSender(
-						system_constants::get_logging_address(),
-						system_constants::get_logging_port()
-				)
-		);
-		return output;
+		std::unique_lock<std::mutex> lck(logger_mutex);
+		logger->send(cmd_buffer);
 	}
 
 
+	// Aggregated counters are exact, so the sampling frequency is accepted but no longer applied
 	void statsd_increment(const std::string &key, const float frequency) {
-		auto client = get_client();
-		client->increment(key, frequency);
-
-		client = get_instance_client();
-		client->increment(key, frequency);
+		statsd_count(key, 1, frequency);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:statsd_increment: key=" << key << std::endl;
@@ -66,11 +217,7 @@ namespace statsd {
 
 
 	void statsd_decrement(const std::string &key, const float frequency) {
-		auto client = get_client();
-		client->decrement(key, frequency);
-
-		client = get_instance_client();
-		client->decrement(key, frequency);
+		statsd_count(key, -1, frequency);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:statsd_decrement: key=" << key << std::endl;
@@ -79,11 +226,10 @@ namespace statsd {
 
 
 	void statsd_count(const std::string &key, const int delta, const float frequency) {
-		auto client = get_client();
-		client->count(key, delta, frequency);
-
-		client = get_instance_client();
-		client->count(key, delta, frequency);
+		auto& reg = registry::inst();
+		const size_t id = reg.counter_id(key);
+		if (id != registry::iInvalidId)
+			reg.count(id, delta);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:statsd_count: key=" << key << ", delta=" << delta << std::endl;
@@ -92,11 +238,10 @@ namespace statsd {
 
 
 	void statsd_gauge(const std::string &key, const unsigned int value, const float frequency) {
-		auto client = get_client();
-		client->gauge(key, value, frequency);
-
-		client = get_instance_client();
-		client->gauge(key, value, frequency);
+		auto& reg = registry::inst();
+		const size_t id = reg.gauge_id(key);
+		if (id != registry::iInvalidId)
+			reg.gauge(id, value);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:statsd_gauge: key=" << key << ", value=" << value << std::endl;
@@ -105,11 +250,7 @@ namespace statsd {
 
 
 	void statsd_timing(const std::string &key, const unsigned int ms, const float frequency) {
-		auto client = get_client();
-		client->timing(key, ms, frequency);
-
-		client = get_instance_client();
-		client->timing(key, ms, frequency);
+		registry::inst().timing(key, ms, frequency);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:statsd_timing: key=" << key << ", ms=" << ms << std::endl;
@@ -119,8 +260,6 @@ namespace statsd {
 
 	// Record the miner connected to the pool
 	void log_login(const std::string & address, const std::string & password, const std::string & user_agent) {
-		auto logger = get_logger();
-
 		nlohmann::json data;
 		data["time"] = get_iso_current_timestamp<std::chrono::microseconds>();
 		data["machine_id"] = system_constants::get_statsd_machine_id();
@@ -129,7 +268,7 @@ namespace statsd {
 		data["event"]["password"] = password;
 		data["event"]["user_agent"] = user_agent;
 		const std::string cmd_buffer = data.dump();
-		logger->send(cmd_buffer);
+		send_log(cmd_buffer);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:log_login: send=" << cmd_buffer << std::endl;
@@ -139,8 +278,6 @@ namespace statsd {
 
 	// Record the miner received a new task
 	void log_job(const std::string & miner_id, const std::string & job_id, const std::string & target, const std::string & blob) {
-		auto logger = get_logger();
-
 		nlohmann::json data;
 		data["time"] = get_iso_current_timestamp<std::chrono::microseconds>();
 		data["machine_id"] = system_constants::get_statsd_machine_id();
@@ -150,7 +287,7 @@ namespace statsd {
 		data["event"]["target"] = target;
 		data["event"]["blob"] = blob;
 		const std::string cmd_buffer = data.dump();
-		logger->send(cmd_buffer);
+		send_log(cmd_buffer);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:log_job: send=" << cmd_buffer << std::endl;
@@ -160,8 +297,6 @@ namespace statsd {
 
 	// Record the miner finished a task
 	void log_result(const std::string & miner_id, const std::string & job_id, const std::string & target, const std::string & blob, const std::string & result, const std::string & nonce) {
-		auto logger = get_logger();
-
 		nlohmann::json data;
 		data["time"] = get_iso_current_timestamp<std::chrono::microseconds>();
 		data["machine_id"] = system_constants::get_statsd_machine_id();
@@ -173,7 +308,7 @@ namespace statsd {
 		data["event"]["result"] = result;
 		data["event"]["nonce"] = nonce;
 		const std::string cmd_buffer = data.dump();
-		logger->send(cmd_buffer);
+		send_log(cmd_buffer);
 
 #ifdef CONFIG_DEBUG_MODE
 		std::cout << __FILE__ << ":" << __LINE__ << ":statsd:log_result: send=" << cmd_buffer << std::endl;
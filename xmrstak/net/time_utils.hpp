@@ -6,6 +6,7 @@
 #define XMR_STAK_TIME_UTILS_H
 
 #include <chrono>
+#include <cstdint>
 
 //Get steady_clock timestamp - misc helper function
 inline unsigned long get_timestamp()
@@ -25,4 +26,11 @@ inline unsigned long get_timestamp_ms()
 	}
 }
 
+//Get microsecond steady_clock timestamp
+inline uint64_t get_timestamp_us()
+{
+	using namespace std::chrono;
+	return time_point_cast<microseconds>(steady_clock::now()).time_since_epoch().count();
+}
+
 #endif //XMR_STAK_TIME_UTILS_H
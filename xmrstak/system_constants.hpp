@@ -23,11 +23,18 @@ namespace system_constants {
 		unknown_value
 	};
 
+	enum thread_sched_cfg {
+		sched_none,
+		sched_yield,
+		sched_idle
+	};
+
 	inline const std::string get_statsd_address() { return std::string(CONFIG_STATSD_ADDRESS); }
 	inline const uint16_t get_statsd_port() { return CONFIG_STATSD_PORT; }
 	inline const std::string get_statsd_prefix() { return CONFIG_STATSD_PREFIX; }
 	inline const std::string get_statsd_machine_prefix() { return CONFIG_STATSD_PREFIX "instance." CONFIG_STATSD_MACHINE_ID "."; }
 	inline const std::string get_statsd_machine_id() { return CONFIG_STATSD_MACHINE_ID; }
+	inline uint64_t get_statsd_flush_interval() { return CONFIG_STATSD_FLUSH_INTERVAL; }
 
 	inline const std::string get_logging_address() { return std::string(CONFIG_LOGGING_ADDRESS); }
 	inline const uint16_t get_logging_port() { return CONFIG_LOGGING_PORT; }
@@ -49,6 +56,20 @@ namespace system_constants {
 	inline bool HaveHardwareAes() { return CONFIG_AES_OVERRIDE; }
 
 	inline slow_mem_cfg GetSlowMemSetting() { return CONFIG_USE_SLOW_MEMORY; }
+
+	inline bool GetScratchpadArena() { return CONFIG_SCRATCHPAD_ARENA; }
+
+	inline bool GetScratchpad1GPages() { return CONFIG_SCRATCHPAD_1G_PAGES; }
+
+	inline thread_sched_cfg GetThreadSchedSetting() { return CONFIG_THREAD_SCHED_POLICY; }
+
+	inline uint64_t GetThreadYieldEvery() { return CONFIG_THREAD_YIELD_EVERY; }
+
+	inline bool GetAutotune() { return CONFIG_AUTOTUNE; }
+
+	inline uint64_t GetAutotuneTrialTime() { return CONFIG_AUTOTUNE_TRIAL_TIME; }
+
+	inline const std::string get_autotune_cache_file() { return std::string(CONFIG_AUTOTUNE_CACHE_FILE); }
 }
 
 #endif //XMR_SLIM_SYSTEM_CONSTANTS_HPP
\ No newline at end of file